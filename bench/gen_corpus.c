@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Writes the benchmark corpus, byte streams shaped like what the
+ * terminal reads from the pty for typical workloads. The streams are
+ * generated from a fixed seed so every run measures the same bytes.
+ * Every stream is written again over what the directory has, real
+ * recordings go in a directory of their own (see the Makefile).
+ *
+ * usage: gen_corpus <directory>
+ */
+
+#define CORPUS_STREAM_SIZE (4 * 1024 * 1024)
+
+#define COLS (80)
+#define ROWS (24)
+
+#define CORPUS_SEED (0x12345678)
+
+static unsigned int seed;
+
+static unsigned int next_random(){
+    // xorshift32
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static int random_between(int a, int b){
+    return a + (next_random() % (b - a + 1));
+}
+
+static void put_utf8(FILE* file, unsigned int codep){
+    if (codep < 0x80){
+        fputc(codep, file);
+    }else if (codep < 0x800){
+        fputc(0xC0 | (codep >> 6), file);
+        fputc(0x80 | (codep & 0x3F), file);
+    }else if (codep < 0x10000){
+        fputc(0xE0 | (codep >> 12), file);
+        fputc(0x80 | ((codep >> 6) & 0x3F), file);
+        fputc(0x80 | (codep & 0x3F), file);
+    }else{
+        fputc(0xF0 | (codep >> 18), file);
+        fputc(0x80 | ((codep >> 12) & 0x3F), file);
+        fputc(0x80 | ((codep >> 6) & 0x3F), file);
+        fputc(0x80 | (codep & 0x3F), file);
+    }
+}
+
+static void put_word(FILE* file, int len){
+    for (int i = 0; i < len; i++){
+        fputc(random_between('a', 'z'), file);
+    }
+}
+
+// ------------------------------------------------------------
+// streams
+// ------------------------------------------------------------
+
+// application logs, plain printable ascii lines.
+static void ascii_log(FILE* file){
+    static char* levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+    static char* methods[] = { "GET", "GET", "POST", "PUT", "DELETE" };
+    int line = 0;
+
+    while (ftell(file) < CORPUS_STREAM_SIZE){
+        fprintf(file,
+                "2024-03-%02d %02d:%02d:%02d.%06d %-5s [worker-%d] %s /api/v1/",
+                1 + (line / 86400) % 28,
+                (line / 3600) % 24,
+                (line / 60) % 60,
+                line % 60,
+                random_between(0, 999999),
+                levels[random_between(0, 5)],
+                random_between(0, 15),
+                methods[random_between(0, 4)]);
+        put_word(file, random_between(3, 10));
+        fprintf(file,
+                "/%d status=%d bytes=%d latency_ms=%d\r\n",
+                random_between(1, 99999),
+                random_between(0, 9) ? 200 : 500,
+                random_between(0, 65535),
+                random_between(0, 2000));
+        line++;
+    }
+}
+
+// every cell with its own truecolor foreground and background.
+static void sgr_truecolor(FILE* file){
+    while (ftell(file) < CORPUS_STREAM_SIZE){
+        for (int x = 0; x < COLS; x++){
+            int r = random_between(0, 255);
+            int g = random_between(0, 255);
+            int b = random_between(0, 255);
+
+            fprintf(file, "\033[48;2;%d;%d;%dm", r, g, b);
+            fprintf(file, "\033[38;2;%d;%d;%dm", 255 - r, 255 - g, 255 - b);
+            fputc(random_between('!', '~'), file);
+
+            if (random_between(0, 7) == 0){
+                fprintf(file, "\033[0m");
+            }
+        }
+        fprintf(file, "\033[m\r\n");
+    }
+}
+
+// full screen redraws of a top like program.
+static void ncurses_redraw(FILE* file){
+    int frame = 0;
+
+    fprintf(file, "\033[?1049h\033[?25l\033[H\033[2J");
+
+    while (ftell(file) < CORPUS_STREAM_SIZE){
+        fprintf(file, "\033[H\033[1;37;44m top - frame %d, load average: %d.%02d",
+                frame,
+                random_between(0, 9),
+                random_between(0, 99));
+        fprintf(file, "\033[K\033[m");
+
+        for (int y = 2; y < ROWS; y++){
+            fprintf(file, "\033[%d;1H", y);
+            if (y == 3){
+                fprintf(file, "\033[7m  PID USER      PR  NI    VIRT    RES  %%CPU COMMAND\033[27m");
+            }else{
+                fprintf(file,
+                        "%5d %-8.8s  20   0 %7d %6d \033[%dm%5.1f\033[39m ",
+                        random_between(1, 32767),
+                        "root",
+                        random_between(1000, 9999999),
+                        random_between(100, 999999),
+                        random_between(0, 3) ? 32 : 31,
+                        random_between(0, 1000) / 10.0);
+                put_word(file, random_between(4, 20));
+            }
+            fprintf(file, "\033[K");
+        }
+        frame++;
+    }
+
+    fprintf(file, "\033[?25h\033[?1049l");
+}
+
+// watch -n0.1 on a command whose output barely changes, the whole
+// screen is sent again on every refresh.
+static void watch(FILE* file){
+    char names[ROWS][21];
+    int pids[ROWS];
+    int cpu[ROWS];
+    int frame = 0;
+
+    for (int y = 0; y < ROWS; y++){
+        int len = random_between(4, 20);
+
+        for (int i = 0; i < len; i++){
+            names[y][i] = random_between('a', 'z');
+        }
+        names[y][len] = 0;
+        pids[y] = random_between(1, 32767);
+        cpu[y] = random_between(0, 999);
+    }
+
+    fprintf(file, "\033[H\033[2J");
+
+    while (ftell(file) < CORPUS_STREAM_SIZE){
+        fprintf(file, "\033[HEvery 0.1s: ps -eo pid,pcpu,comm%29sbench: %02d:%02d:%02d.%d\033[K\r\n",
+                "",
+                (frame / 36000) % 24,
+                (frame / 600) % 60,
+                (frame / 10) % 60,
+                frame % 10);
+        fprintf(file, "\033[K\r\n  PID %%CPU COMMAND\033[K\r\n");
+
+        for (int y = 3; y < ROWS - 1; y++){
+            if (random_between(0, 15) == 0){
+                cpu[y] = random_between(0, 999);
+            }
+            fprintf(file, "%5d %2d.%d %s\033[K\r\n", pids[y], cpu[y] / 10, cpu[y] % 10, names[y]);
+        }
+        fprintf(file, "\033[J");
+        frame++;
+    }
+}
+
+// scrolling through a source file in vim, the status line is
+// outside of the scrolling region.
+static void vim_scroll(FILE* file){
+    int line = 1;
+
+    fprintf(file, "\033[?1049h\033[H\033[2J\033[1;%dr", ROWS - 1);
+
+    while (ftell(file) < CORPUS_STREAM_SIZE){
+        int up = random_between(0, 3) == 0;
+        int count = random_between(1, 5);
+
+        for (int i = 0; i < count; i++){
+            if (up){
+                fprintf(file, "\033[1;1H\033M");
+                line = line > 1 ? line - 1 : 1;
+            }else{
+                fprintf(file, "\033[%d;1H\n", ROWS - 1);
+                line++;
+            }
+
+            fprintf(file, "\033[33m%4d \033[m", line);
+            for (int x = 5; x < COLS - 10; ){
+                int len = random_between(2, 8);
+
+                fprintf(file, "\033[38;5;%dm", random_between(1, 255));
+                put_word(file, len);
+                fprintf(file, "\033[m ");
+                x += len + 1;
+            }
+        }
+
+        fprintf(file, "\033[%d;1H\033[1m\"main.c\"\033[m %d lines\033[K", ROWS, line);
+        fprintf(file, "\033[%d;%dH%d,1", ROWS, COLS - 18, line);
+    }
+
+    fprintf(file, "\033[r\033[?1049l");
+}
+
+// wide characters, emoji and their modifiers.
+static void cjk_emoji(FILE* file){
+    while (ftell(file) < CORPUS_STREAM_SIZE){
+        for (int x = 0; x < COLS / 2; x++){
+            switch (random_between(0, 7)){
+                case 0:
+                    put_utf8(file, random_between(0x1F600, 0x1F64F));
+                    break;
+                case 1:
+                    // emoji with a skin tone modifier.
+                    put_utf8(file, 0x1F44D);
+                    put_utf8(file, random_between(0x1F3FB, 0x1F3FF));
+                    break;
+                case 2:
+                    // zero width joiner sequence.
+                    put_utf8(file, 0x1F468);
+                    put_utf8(file, 0x200D);
+                    put_utf8(file, 0x1F4BB);
+                    break;
+                case 3:
+                    put_utf8(file, random_between(0xAC00, 0xD7A3));
+                    break;
+                case 4:
+                    put_utf8(file, random_between(0x3041, 0x3096));
+                    break;
+                default:
+                    put_utf8(file, random_between(0x4E00, 0x9FFF));
+                    break;
+            }
+        }
+        fprintf(file, "\r\n");
+    }
+}
+
+// ------------------------------------------------------------
+
+typedef struct{
+    char* name;
+    void (*generate)(FILE* file);
+}TCorpusStream;
+
+static TCorpusStream streams[] = {
+    { "ascii_log",       ascii_log },
+    { "sgr_truecolor",   sgr_truecolor },
+    { "ncurses_redraw",  ncurses_redraw },
+    { "vim_scroll",      vim_scroll },
+    { "cjk_emoji",       cjk_emoji },
+    { "watch",           watch },
+};
+
+int main(int argc, char** argv){
+    char path[4096];
+    FILE* file;
+
+    if (argc != 2){
+        fprintf(stderr, "usage: %s <directory>\n", argv[0]);
+        return -1;
+    }
+
+    for (int i = 0; i < sizeof(streams) / sizeof(streams[0]); i++){
+        snprintf(path, sizeof(path), "%s/%s", argv[1], streams[i].name);
+        file = fopen(path, "wb");
+        if (!file){
+            fprintf(stderr, "failed to create %s.\n", path);
+            return -1;
+        }
+        seed = CORPUS_SEED;
+        streams[i].generate(file);
+        fclose(file);
+    }
+
+    return 0;
+}
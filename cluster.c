@@ -0,0 +1,198 @@
+#include "cluster.h"
+#include "common.h"
+#include "utf8.h"
+
+#include <string.h>
+
+
+// id states
+#define CLUSTER_FREE    (0)
+#define CLUSTER_USED    (1)
+#define CLUSTER_MARKED  (2)
+
+static unsigned int cluster_hash(unsigned int* codes, int length){
+    unsigned int hash = 0x811C9DC5U;
+
+    for (int i = 0; i < length; i++){
+        hash = (hash ^ codes[i]) * 0x01000193U;
+    }
+    return hash ^ (hash >> 16);
+}
+
+static int cluster_equal(TCluster* cluster, unsigned int* codes, int length){
+    return  (cluster->length == length) &&
+            (memcmp(cluster->codes, codes, sizeof(unsigned int) * length) == 0);
+}
+
+static void cluster_index_insert(TClusterTable* table, int id){
+    unsigned int mask = table->buckets_number - 1;
+    TCluster* cluster = &table->clusters[id];
+    unsigned int bucket = cluster_hash(cluster->codes, cluster->length) & mask;
+
+    while (table->buckets[bucket]){
+        bucket = (bucket + 1) & mask;
+    }
+    table->buckets[bucket] = id + 1;
+}
+
+static void cluster_index_rebuild(TClusterTable* table){
+    memset(table->buckets, 0, sizeof(unsigned int) * table->buckets_number);
+
+    for (int id = 0; id < table->next_id; id++){
+        if (table->marks[id] != CLUSTER_FREE){
+            cluster_index_insert(table, id);
+        }
+    }
+}
+
+static int cluster_table_allocate(TClusterTable* table, int capacity){
+    TCluster* clusters;
+    unsigned char* marks;
+    unsigned int* free_ids;
+    unsigned int* buckets;
+
+    clusters = (TCluster*) realloc(table->clusters, sizeof(TCluster) * capacity);
+    ASSERT(clusters, "failed to realloc clusters.\n");
+    table->clusters = clusters;
+
+    marks = (unsigned char*) realloc(table->marks, capacity);
+    ASSERT(marks, "failed to realloc cluster marks.\n");
+    memset(&marks[table->capacity], CLUSTER_FREE, capacity - table->capacity);
+    table->marks = marks;
+
+    free_ids = (unsigned int*) realloc(table->free_ids, sizeof(unsigned int) * capacity);
+    ASSERT(free_ids, "failed to realloc free cluster ids.\n");
+    table->free_ids = free_ids;
+
+    // kept at most half full.
+    buckets = (unsigned int*) realloc(table->buckets, sizeof(unsigned int) * capacity * 2);
+    ASSERT(buckets, "failed to realloc cluster buckets.\n");
+    table->buckets = buckets;
+    table->buckets_number = capacity * 2;
+
+    table->capacity = capacity;
+    return 0;
+
+fail:
+    return -1;
+}
+
+TClusterTable* cluster_table_create(void){
+    TClusterTable* table = NULL;
+    int ret;
+
+    table = (TClusterTable*) malloc(sizeof(TClusterTable));
+    ASSERT(table, "failed to malloc() cluster table.\n");
+    memset(table, 0, sizeof(TClusterTable));
+
+    ret = cluster_table_allocate(table, CLUSTERS_INITIAL_CAPACITY);
+    ASSERT_TO(fail_on_allocate, (ret == 0), "failed to allocate cluster table.\n");
+
+    cluster_table_reset(table);
+    return table;
+
+fail_on_allocate:
+    cluster_table_destroy(table);
+fail:
+    return NULL;
+}
+
+void cluster_table_destroy(TClusterTable* table){
+    ASSERT(table, "trying to destroy NULL cluster table.\n");
+
+    free(table->clusters);
+    free(table->marks);
+    free(table->free_ids);
+    free(table->buckets);
+    free(table);
+
+fail:
+    return;
+}
+
+void cluster_table_reset(TClusterTable* table){
+    memset(table->marks, CLUSTER_FREE, table->capacity);
+
+    table->clusters_number = 0;
+    table->next_id = 0;
+    table->free_ids_number = 0;
+
+    cluster_index_rebuild(table);
+}
+
+int cluster_table_grow(TClusterTable* table){
+    int ret;
+
+    ASSERT((table->capacity < CLUSTERS_MAX), "cluster table is at its maximum size.\n");
+
+    ret = cluster_table_allocate(table, table->capacity * 2);
+    ASSERT((ret == 0), "failed to grow cluster table.\n");
+
+    cluster_index_rebuild(table);
+    return 0;
+
+fail:
+    return -1;
+}
+
+int cluster_intern(TClusterTable* table, unsigned int* codes, int length){
+    unsigned int mask = table->buckets_number - 1;
+    unsigned int bucket = cluster_hash(codes, length) & mask;
+    int id;
+
+    while (table->buckets[bucket]){
+        id = table->buckets[bucket] - 1;
+        if (cluster_equal(&table->clusters[id], codes, length)){
+            return id;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+
+    if (table->free_ids_number > 0){
+        id = table->free_ids[--table->free_ids_number];
+    }else if (table->next_id < table->capacity){
+        id = table->next_id++;
+    }else{
+        return -1;
+    }
+
+    memcpy(table->clusters[id].codes, codes, sizeof(unsigned int) * length);
+    table->clusters[id].length = length;
+    table->marks[id] = CLUSTER_USED;
+    table->clusters_number++;
+
+    // the empty bucket the lookup stopped at.
+    table->buckets[bucket] = id + 1;
+    return id;
+}
+
+void cluster_mark(TClusterTable* table, unsigned int id){
+    if (table->marks[id] != CLUSTER_FREE){
+        table->marks[id] = CLUSTER_MARKED;
+    }
+}
+
+void cluster_sweep(TClusterTable* table){
+    for (int id = 0; id < table->next_id; id++){
+        if (table->marks[id] == CLUSTER_USED){
+            table->marks[id] = CLUSTER_FREE;
+            table->free_ids[table->free_ids_number++] = id;
+            table->clusters_number--;
+        }else if (table->marks[id] == CLUSTER_MARKED){
+            table->marks[id] = CLUSTER_USED;
+        }
+    }
+
+    cluster_index_rebuild(table);
+}
+
+int cluster_encode(TClusterTable* table, unsigned int character_code, char* buf){
+    unsigned int* codes;
+    int length = cluster_codes(table, &character_code, &codes);
+    int size = 0;
+
+    for (int i = 0; i < length; i++){
+        size += utf8_encode(codes[i], &buf[size]);
+    }
+    return size;
+}
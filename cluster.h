@@ -0,0 +1,106 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+/*
+ * Interned grapheme clusters, the characters of more than one codepoint:
+ * a character with the combining marks, variation selectors or emoji
+ * modifiers after it, emoji joined by ZWJ, or a flag made of a pair of
+ * regional indicators. A cell of a single codepoint holds it as is, a
+ * cell of a cluster holds ELEMENT_CLUSTER and the id of the cluster.
+ *
+ * As with the styles (see style.h) ids are not reference counted, the
+ * owner of the table marks the ids it still uses and sweeps the rest
+ * once the table fills up, so the clusters of the rows which were
+ * erased or dropped from the scrollback are reclaimed then.
+ */
+
+#include "element.h"
+#include "unicode.h"
+
+#define CLUSTER_CODES_MAX           (15) // the codepoints past it are dropped.
+#define CLUSTERS_MAX                (0x10000)
+#define CLUSTERS_INITIAL_CAPACITY   (256)
+#define CLUSTER_UTF8_MAX            (4 * CLUSTER_CODES_MAX)
+
+#define UNICODE_ZWJ                 (0x200D)
+#define UNICODE_IS_REGIONAL(code)   ((code) >= 0x1F1E6 && (code) <= 0x1F1FF)
+
+// 64 bytes.
+typedef struct{
+    unsigned int codes[CLUSTER_CODES_MAX];
+    int length;
+}TCluster;
+
+typedef struct{
+    TCluster* clusters;     // by id.
+    unsigned char* marks;   // state of every id: free, used or marked.
+    int capacity;
+    int clusters_number;
+
+    // ids that were swept, and the first id never given.
+    unsigned int* free_ids;
+    int free_ids_number;
+    int next_id;
+
+    // open addressing index from a cluster to its id + 1 (0 is empty).
+    unsigned int* buckets;
+    int buckets_number;
+}TClusterTable;
+
+
+TClusterTable* cluster_table_create(void);
+void cluster_table_destroy(TClusterTable* table);
+
+// drops every cluster.
+void cluster_table_reset(TClusterTable* table);
+
+// doubles the capacity, fails at CLUSTERS_MAX.
+int cluster_table_grow(TClusterTable* table);
+
+// the id of the cluster of length codepoints, -1 if the table is full.
+int cluster_intern(TClusterTable* table, unsigned int* codes, int length);
+
+void cluster_mark(TClusterTable* table, unsigned int id);
+
+// frees every id that was not marked since the last sweep.
+void cluster_sweep(TClusterTable* table);
+
+// the codepoints of the character of a cell, at character_code.
+static inline int cluster_codes(TClusterTable* table, unsigned int* character_code, unsigned int** codes){
+    if (*character_code & ELEMENT_CLUSTER){
+        TCluster* cluster = &table->clusters[*character_code & ~ELEMENT_CLUSTER];
+
+        *codes = cluster->codes;
+        return cluster->length;
+    }
+    *codes = character_code;
+    return 1;
+}
+
+// utf8 of every codepoint of the character, at most CLUSTER_UTF8_MAX bytes.
+int cluster_encode(TClusterTable* table, unsigned int character_code, char* buf);
+
+/*
+ * Whether code goes on the cluster of codes rather than starting a
+ * character of its own: the characters which take no cell, a pictograph
+ * after a ZWJ and the second regional indicator of a flag.
+ */
+static inline int cluster_extends(unsigned int* codes, int length, unsigned int code){
+    unsigned int properties;
+
+    // nothing below the combining diacritical marks goes on anything.
+    if (code < 0x300){
+        return 0;
+    }
+
+    properties = unicode_properties(code);
+    if ((properties & UNICODE_WIDTH_MASK) == 0){
+        return 1;
+    }
+    if (codes[length - 1] == UNICODE_ZWJ){
+        return (properties & UNICODE_PICTOGRAPHIC) != 0;
+    }
+    return length == 1 && UNICODE_IS_REGIONAL(codes[0]) && UNICODE_IS_REGIONAL(code);
+}
+
+#endif
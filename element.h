@@ -2,13 +2,24 @@
 #define ELEMENT_H
 
 
+// 8 bytes, the colors and attributes are interned in the terminal 
+// style table (see style.h).
 typedef struct{
     unsigned int character_code;
-    unsigned int attributes;
-	unsigned int foreground_color;
-	unsigned int background_color;
-    unsigned int dirty;
+    unsigned short style;
+    unsigned short flags;
 }TElement;
 
+// the cell after a wide character, which the character is drawn over.
+#define ELEMENT_SPACER (0)
+
+// flags, the blank left at the end of a row by a wide character which
+// went on the next row, it is not part of the line.
+#define ELEMENT_PAD (1 << 0)
+
+// a character of more than one codepoint, the low bits are the id of
+// its cluster in the table of the terminal (see cluster.h).
+#define ELEMENT_CLUSTER (1U << 31)
+
 
 #endif
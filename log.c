@@ -0,0 +1,180 @@
+#include "log.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+
+typedef struct{
+    // equals to the write position when the slot is free, and to
+    // the write position + 1 when it holds a message.
+    unsigned int sequence;
+    int length;
+    char message[LOG_MESSAGE_SIZE];
+}TLogSlot;
+
+int log_trace_enabled = 0;
+
+static TLogSlot log_ring[LOG_RING_SIZE];
+static unsigned int log_head = 0; // next slot to write.
+static unsigned int log_tail = 0; // next slot to flush.
+static unsigned int log_dropped = 0;
+
+static FILE* log_file = NULL;
+static pthread_t log_thread;
+static int log_running = 0;
+
+// messages are written to the file in batches of this size.
+static char log_batch[LOG_MESSAGE_SIZE * 64];
+
+
+static void log_flush(){
+    int batch_len = 0;
+    unsigned int dropped;
+
+    while (1){
+        TLogSlot* slot = &log_ring[log_tail & (LOG_RING_SIZE - 1)];
+        unsigned int sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence != log_tail + 1){
+            break; // empty
+        }
+
+        if (batch_len + slot->length > sizeof(log_batch)){
+            fwrite(log_batch, 1, batch_len, log_file);
+            batch_len = 0;
+        }
+        memcpy(&log_batch[batch_len], slot->message, slot->length);
+        batch_len += slot->length;
+
+        // free the slot for the next round of the ring.
+        __atomic_store_n(&slot->sequence, log_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        log_tail++;
+    }
+
+    if (batch_len > 0){
+        fwrite(log_batch, 1, batch_len, log_file);
+    }
+
+    dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0){
+        fprintf(log_file, "log ring was full, %u messages dropped.\n", dropped);
+    }
+
+    fflush(log_file);
+}
+
+static void* log_thread_main(void* arg){
+    struct timespec interval = {
+        .tv_sec = 0,
+        .tv_nsec = LOG_FLUSH_INTERVAL_MS * 1000000L
+    };
+
+    while (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)){
+        nanosleep(&interval, NULL);
+        log_flush();
+    }
+
+    return NULL;
+}
+
+int log_start(char* path){
+    unsigned int i;
+
+    if (log_running){
+        return 0;
+    }
+
+    log_file = fopen(path ? path : LOG_DEFAULT_FILE_PATH, "a");
+    if (!log_file){
+        return -1;
+    }
+
+    for (i = 0; i < LOG_RING_SIZE; i++){
+        log_ring[i].sequence = i;
+    }
+    log_head = 0;
+    log_tail = 0;
+
+    __atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+
+    if (pthread_create(&log_thread, NULL, log_thread_main, NULL) != 0){
+        __atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);
+        fclose(log_file);
+        log_file = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void log_stop(){
+    if (!log_running){
+        return;
+    }
+
+    __atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);
+    pthread_join(log_thread, NULL);
+
+    // whatever was written after the last flush.
+    log_flush();
+
+    fclose(log_file);
+    log_file = NULL;
+}
+
+void log_set_trace(int enabled){
+    log_trace_enabled = enabled;
+}
+
+void log_write(int level, const char* format, ...){
+    TLogSlot* slot;
+    unsigned int position;
+    va_list args;
+    int length;
+
+    if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)){
+        return;
+    }
+
+    // claim a slot.
+    position = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+    while (1){
+        slot = &log_ring[position & (LOG_RING_SIZE - 1)];
+        int diff = (int) (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+
+        if (diff == 0){
+            if (__atomic_compare_exchange_n(&log_head,
+                                            &position,
+                                            position + 1,
+                                            1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)){
+                break;
+            }
+        }else if (diff < 0){
+            // the ring is full, the flushing thread is behind.
+            __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }else{
+            position = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    va_start(args, format);
+    length = vsnprintf(slot->message, sizeof(slot->message), format, args);
+    va_end(args);
+
+    if (length < 0){
+        length = 0;
+    }
+    if (length >= sizeof(slot->message)){
+        length = sizeof(slot->message) - 1;
+    }
+    slot->length = length;
+
+    // publish the message.
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
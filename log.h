@@ -0,0 +1,58 @@
+#ifndef LOG_H
+#define LOG_H
+
+/*
+ * Messages are formatted into a lock free in memory ring by the
+ * logging thread (any thread), and written to the log file in
+ * batches by a background thread started with log_start().
+ * Nothing is written before log_start() was called.
+ */
+
+// log levels
+#define LOG_LEVEL_NONE      (0)
+#define LOG_LEVEL_ERROR     (1)
+#define LOG_LEVEL_INFO      (2)
+#define LOG_LEVEL_DEBUG     (3)
+#define LOG_LEVEL_TRACE     (4)
+
+// messages above this level are compiled out.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_TRACE
+#endif
+
+#define LOG_DEFAULT_FILE_PATH "/tmp/terminal.log"
+
+#define LOG_MESSAGE_SIZE (256)
+#define LOG_RING_SIZE (1024) // must be a power of 2.
+#define LOG_FLUSH_INTERVAL_MS (50)
+
+// runtime switch for the trace level (per sequence tracing), not to be
+// set from a signal handler.
+extern int log_trace_enabled;
+
+int log_start(char* path);
+void log_stop();
+
+void log_set_trace(int enabled);
+
+void log_write(int level, const char* format, ...);
+
+#define LOG_AT(level, ...) do{                                          \
+    if ((level) <= LOG_COMPILE_LEVEL){                                  \
+        log_write((level), __VA_ARGS__);                                \
+    }                                                                   \
+}while(0)
+
+#define LOG_ERROR(...)  LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_INFO(...)   LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...)  LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#define LOG_TRACING() ((LOG_LEVEL_TRACE <= LOG_COMPILE_LEVEL) && log_trace_enabled)
+
+#define LOG_TRACE(...) do{                                              \
+    if (LOG_TRACING()){                                                 \
+        log_write(LOG_LEVEL_TRACE, __VA_ARGS__);                        \
+    }                                                                   \
+}while(0)
+
+#endif
@@ -0,0 +1,216 @@
+#include "lz.h"
+#include "common.h"
+
+#include <string.h>
+
+
+static inline unsigned int lz_read32(unsigned char* p){
+    unsigned int value;
+
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline unsigned int lz_hash(unsigned int value){
+    return (value * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static inline int lz_put_length(unsigned char* out, int op, int capacity, int length){
+    for (; length >= 255; length -= 255){
+        if (op >= capacity){
+            return -1;
+        }
+        out[op++] = 255;
+    }
+    if (op >= capacity){
+        return -1;
+    }
+    out[op++] = length;
+    return op;
+}
+
+// writes a sequence, a match length of 0 means literals only.
+static int lz_put_sequence(unsigned char* out, int op, int capacity,
+                           unsigned char* literals, int literals_length,
+                           int offset, int match_length){
+    int literals_nibble = literals_length < 15 ? literals_length : 15;
+    int match_nibble = 0;
+
+    if (match_length > 0){
+        match_length -= LZ_MIN_MATCH;
+        match_nibble = match_length < 15 ? match_length : 15;
+    }
+
+    if (op >= capacity){
+        return -1;
+    }
+    out[op++] = (literals_nibble << 4) | match_nibble;
+
+    if (literals_nibble == 15){
+        op = lz_put_length(out, op, capacity, literals_length - 15);
+        if (op < 0){
+            return -1;
+        }
+    }
+
+    if (op + literals_length > capacity){
+        return -1;
+    }
+    memcpy(&out[op], literals, literals_length);
+    op += literals_length;
+
+    if (offset == 0){
+        return op;
+    }
+
+    if (op + 2 > capacity){
+        return -1;
+    }
+    out[op++] = offset & 0xFF;
+    out[op++] = offset >> 8;
+
+    if (match_nibble == 15){
+        op = lz_put_length(out, op, capacity, match_length - 15);
+    }
+    return op;
+}
+
+// the number of equal bytes at a and b, up to limit.
+static inline int lz_match_length(unsigned char* a, unsigned char* b, int limit){
+    unsigned long long x, y;
+    int length = 0;
+
+    while (length + 8 <= limit){
+        memcpy(&x, &a[length], sizeof(x));
+        memcpy(&y, &b[length], sizeof(y));
+        if (x != y){
+            return length + (__builtin_ctzll(x ^ y) / 8);
+        }
+        length += 8;
+    }
+    while (length < limit && a[length] == b[length]){
+        length++;
+    }
+    return length;
+}
+
+int lz_compress(char* src, int len, char* dst, int capacity){
+    unsigned char* in = (unsigned char*) src;
+    unsigned char* out = (unsigned char*) dst;
+    int table[1 << LZ_HASH_BITS]; // position + 1 of the last 4 bytes with the hash.
+    int anchor = 0;
+    int misses = 0;
+    int op = 0;
+    int i = 0;
+
+    memset(table, 0, sizeof(table));
+
+    while (i + LZ_MIN_MATCH <= len){
+        unsigned int value = lz_read32(&in[i]);
+        unsigned int hash = lz_hash(value);
+        int ref = table[hash] - 1;
+
+        table[hash] = i + 1;
+
+        if (ref < 0 || i - ref > LZ_MAX_OFFSET || lz_read32(&in[ref]) != value){
+            // skip faster over data that does not compress.
+            i += 1 + (misses++ >> 5);
+            continue;
+        }
+        misses = 0;
+
+        int match_length = LZ_MIN_MATCH + lz_match_length(&in[ref + LZ_MIN_MATCH],
+                                                          &in[i + LZ_MIN_MATCH],
+                                                          len - i - LZ_MIN_MATCH);
+
+        op = lz_put_sequence(out, op, capacity, &in[anchor], i - anchor, i - ref, match_length);
+        if (op < 0){
+            return -1;
+        }
+
+        i += match_length;
+        anchor = i;
+    }
+
+    return lz_put_sequence(out, op, capacity, &in[anchor], len - anchor, 0, 0);
+}
+
+static inline int lz_get_length(unsigned char* in, int* ip, int len, int length){
+    unsigned char byte;
+
+    do{
+        if (*ip >= len){
+            return -1;
+        }
+        byte = in[(*ip)++];
+        length += byte;
+    }while (byte == 255);
+
+    return length;
+}
+
+int lz_decompress(char* src, int len, char* dst, int capacity){
+    unsigned char* in = (unsigned char*) src;
+    unsigned char* out = (unsigned char*) dst;
+    int ip = 0;
+    int op = 0;
+
+    while (ip < len){
+        unsigned char token = in[ip++];
+        int literals_length = token >> 4;
+        int match_length = token & 0x0F;
+        int offset;
+
+        if (literals_length == 15){
+            literals_length = lz_get_length(in, &ip, len, literals_length);
+            ASSERT((literals_length >= 0), "lz -> literals length is cut.\n");
+        }
+        ASSERT((ip + literals_length <= len && op + literals_length <= capacity),
+               "lz -> literals out of bounds.\n");
+
+        memcpy(&out[op], &in[ip], literals_length);
+        ip += literals_length;
+        op += literals_length;
+
+        // the last sequence.
+        if (ip == len){
+            break;
+        }
+
+        ASSERT((ip + 2 <= len), "lz -> offset is cut.\n");
+        offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+
+        if (match_length == 15){
+            match_length = lz_get_length(in, &ip, len, match_length);
+            ASSERT((match_length >= 0), "lz -> match length is cut.\n");
+        }
+        match_length += LZ_MIN_MATCH;
+
+        ASSERT((offset > 0 && offset <= op), "lz -> bad match offset.\n");
+        ASSERT((op + match_length <= capacity), "lz -> match out of bounds.\n");
+
+        // an overlapping match repeats the bytes it copies, 8 at 
+        // a time while they do not overlap within a copy.
+        if (offset >= 8 && op + match_length + 8 <= capacity){
+            unsigned char* from = &out[op - offset];
+            unsigned char* to = &out[op];
+
+            for (int i = 0; i < match_length; i += 8){
+                memcpy(&to[i], &from[i], 8);
+            }
+            op += match_length;
+        }else if (offset >= match_length){
+            memcpy(&out[op], &out[op - offset], match_length);
+            op += match_length;
+        }else{
+            for (int i = 0; i < match_length; i++, op++){
+                out[op] = out[op - offset];
+            }
+        }
+    }
+    return op;
+
+fail:
+    return -1;
+}
@@ -0,0 +1,26 @@
+#ifndef LZ_H
+#define LZ_H
+
+/*
+ * A small LZ77 codec in the spirit of LZ4, used for the cold segments
+ * of the scrollback. A block is a list of sequences: a token whose
+ * high nibble is the literals length and low nibble the match length
+ * minus LZ_MIN_MATCH (15 means more length bytes follow, each adding
+ * up to 255), the literals, then a 2 byte little endian offset back
+ * into the output. The last sequence has only literals.
+ */
+
+#define LZ_MIN_MATCH    (4)
+#define LZ_MAX_OFFSET   (0xFFFF)
+#define LZ_HASH_BITS    (12)
+
+// the size dst must have to compress len bytes.
+#define LZ_BOUND(len)   ((len) + ((len) / 255) + 16)
+
+// returns the compressed size, -1 if it did not fit in capacity.
+int lz_compress(char* src, int len, char* dst, int capacity);
+
+// returns the decompressed size, -1 on a corrupted block.
+int lz_decompress(char* src, int len, char* dst, int capacity);
+
+#endif
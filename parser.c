@@ -0,0 +1,200 @@
+#include "parser.h"
+
+
+#define T(action, state)    ((unsigned char) (((state) << 4) | (action)))
+
+#define R2(x)   x, x
+#define R3(x)   R2(x), x
+#define R4(x)   R2(x), R2(x)
+#define R7(x)   R4(x), R3(x)
+#define R8(x)   R4(x), R4(x)
+#define R10(x)  R8(x), R2(x)
+#define R15(x)  R8(x), R7(x)
+#define R16(x)  R8(x), R8(x)
+
+// 0x20 - 0x7E
+#define GL(x)   R16(x), R16(x), R16(x), R16(x), R16(x), R15(x)
+
+// 0x40 - 0x7E (final characters)
+#define FINAL(x) R16(x), R16(x), R16(x), R15(x)
+
+#define STAY(action) T(action, STATE_NONE)
+
+/*
+ * 0x00 - 0x1F: CAN and SUB abort the current sequence and ESC starts
+ * a new one from any state, the rest of the controls get x.
+ */
+#define C0(x)                                                           \
+    R16(x),                                 /* 0x00 - 0x0F */           \
+    R8(x),                                  /* 0x10 - 0x17 */           \
+    T(ACTION_EXECUTE, STATE_GROUND),        /* 0x18 CAN */              \
+    x,                                      /* 0x19 */                  \
+    T(ACTION_EXECUTE, STATE_GROUND),        /* 0x1A SUB */              \
+    T(ACTION_IGNORE, STATE_ESCAPE),         /* 0x1B ESC */              \
+    R4(x)                                   /* 0x1C - 0x1F */
+
+/*
+ * 0x80 - 0x9F: the 8bit equivalents of ESC Fe,
+ * they are handled the same way in every state.
+ */
+#define C1                                                              \
+    R16(T(ACTION_EXECUTE, STATE_GROUND)),       /* 0x80 - 0x8F */       \
+    T(ACTION_IGNORE, STATE_DCS_ENTRY),          /* 0x90 DCS */          \
+    R7(T(ACTION_EXECUTE, STATE_GROUND)),        /* 0x91 - 0x97 */       \
+    T(ACTION_IGNORE, STATE_SOS_PM_APC_STRING),  /* 0x98 SOS */          \
+    R2(T(ACTION_EXECUTE, STATE_GROUND)),        /* 0x99 - 0x9A */       \
+    T(ACTION_IGNORE, STATE_CSI_ENTRY),          /* 0x9B CSI */          \
+    T(ACTION_IGNORE, STATE_GROUND),             /* 0x9C ST */           \
+    T(ACTION_IGNORE, STATE_OSC_STRING),         /* 0x9D OSC */          \
+    R2(T(ACTION_IGNORE, STATE_SOS_PM_APC_STRING)) /* 0x9E PM, 0x9F APC */
+
+
+const unsigned char vt_transitions[STATES_NUMBER][PARSER_COLUMNS] = {
+    [STATE_GROUND] = {
+        C0(STAY(ACTION_EXECUTE)),
+        GL(STAY(ACTION_PRINT)),
+        STAY(ACTION_EXECUTE),                           // 0x7F
+        C1,
+        STAY(ACTION_PRINT)                              // >= 0xA0
+    },
+    [STATE_ESCAPE] = {
+        C0(STAY(ACTION_EXECUTE)),
+        R16(T(ACTION_COLLECT, STATE_ESCAPE_INTERMEDIATE)), // 0x20 - 0x2F
+        R16(T(ACTION_ESC_DISPATCH, STATE_GROUND)),      // 0x30 - 0x3F
+        R16(T(ACTION_ESC_DISPATCH, STATE_GROUND)),      // 0x40 - 0x4F
+        T(ACTION_IGNORE, STATE_DCS_ENTRY),              // 'P'
+        R7(T(ACTION_ESC_DISPATCH, STATE_GROUND)),       // 0x51 - 0x57
+        T(ACTION_IGNORE, STATE_SOS_PM_APC_STRING),      // 'X'
+        R2(T(ACTION_ESC_DISPATCH, STATE_GROUND)),       // 0x59 - 0x5A
+        T(ACTION_IGNORE, STATE_CSI_ENTRY),              // '['
+        T(ACTION_ESC_DISPATCH, STATE_GROUND),           // '\'
+        T(ACTION_IGNORE, STATE_OSC_STRING),             // ']'
+        R2(T(ACTION_IGNORE, STATE_SOS_PM_APC_STRING)),  // '^', '_'
+        R16(T(ACTION_ESC_DISPATCH, STATE_GROUND)),      // 0x60 - 0x6F
+        R15(T(ACTION_ESC_DISPATCH, STATE_GROUND)),      // 0x70 - 0x7E
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_ESCAPE_INTERMEDIATE] = {
+        C0(STAY(ACTION_EXECUTE)),
+        R16(STAY(ACTION_COLLECT)),                      // 0x20 - 0x2F
+        R16(T(ACTION_ESC_DISPATCH, STATE_GROUND)),      // 0x30 - 0x3F
+        FINAL(T(ACTION_ESC_DISPATCH, STATE_GROUND)),    // 0x40 - 0x7E
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_CSI_ENTRY] = {
+        C0(STAY(ACTION_EXECUTE)),
+        R16(T(ACTION_COLLECT, STATE_CSI_INTERMEDIATE)), // 0x20 - 0x2F
+        R10(T(ACTION_PARAM, STATE_CSI_PARAM)),          // '0' - '9'
+        T(ACTION_PARAM, STATE_CSI_PARAM),               // ':'
+        T(ACTION_PARAM, STATE_CSI_PARAM),               // ';'
+        R4(T(ACTION_COLLECT, STATE_CSI_PARAM)),         // '<', '=', '>', '?'
+        FINAL(T(ACTION_CSI_DISPATCH, STATE_GROUND)),    // 0x40 - 0x7E
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_CSI_PARAM] = {
+        C0(STAY(ACTION_EXECUTE)),
+        R16(T(ACTION_COLLECT, STATE_CSI_INTERMEDIATE)), // 0x20 - 0x2F
+        R10(STAY(ACTION_PARAM)),                        // '0' - '9'
+        STAY(ACTION_PARAM),                             // ':'
+        STAY(ACTION_PARAM),                             // ';'
+        R4(T(ACTION_IGNORE, STATE_CSI_IGNORE)),         // '<', '=', '>', '?'
+        FINAL(T(ACTION_CSI_DISPATCH, STATE_GROUND)),    // 0x40 - 0x7E
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_CSI_INTERMEDIATE] = {
+        C0(STAY(ACTION_EXECUTE)),
+        R16(STAY(ACTION_COLLECT)),                      // 0x20 - 0x2F
+        R16(T(ACTION_IGNORE, STATE_CSI_IGNORE)),        // 0x30 - 0x3F
+        FINAL(T(ACTION_CSI_DISPATCH, STATE_GROUND)),    // 0x40 - 0x7E
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_CSI_IGNORE] = {
+        C0(STAY(ACTION_EXECUTE)),
+        R16(STAY(ACTION_IGNORE)),                       // 0x20 - 0x2F
+        R16(STAY(ACTION_IGNORE)),                       // 0x30 - 0x3F
+        FINAL(T(ACTION_IGNORE, STATE_GROUND)),          // 0x40 - 0x7E
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_OSC_STRING] = {
+        R4(STAY(ACTION_IGNORE)),                        // 0x00 - 0x03
+        R3(STAY(ACTION_IGNORE)),                        // 0x04 - 0x06
+        T(ACTION_IGNORE, STATE_GROUND),                 // BEL ends the string.
+        R8(STAY(ACTION_IGNORE)),                        // 0x08 - 0x0F
+        R8(STAY(ACTION_IGNORE)),                        // 0x10 - 0x17
+        T(ACTION_EXECUTE, STATE_GROUND),                // CAN
+        STAY(ACTION_IGNORE),                            // 0x19
+        T(ACTION_EXECUTE, STATE_GROUND),                // SUB
+        T(ACTION_IGNORE, STATE_ESCAPE),                 // ESC
+        R4(STAY(ACTION_IGNORE)),                        // 0x1C - 0x1F
+        GL(STAY(ACTION_OSC_PUT)),
+        STAY(ACTION_OSC_PUT),                           // 0x7F
+        C1,
+        STAY(ACTION_OSC_PUT)                            // >= 0xA0
+    },
+    [STATE_DCS_ENTRY] = {
+        C0(STAY(ACTION_IGNORE)),
+        R16(T(ACTION_COLLECT, STATE_DCS_INTERMEDIATE)), // 0x20 - 0x2F
+        R10(T(ACTION_PARAM, STATE_DCS_PARAM)),          // '0' - '9'
+        T(ACTION_IGNORE, STATE_DCS_IGNORE),             // ':'
+        T(ACTION_PARAM, STATE_DCS_PARAM),               // ';'
+        R4(T(ACTION_COLLECT, STATE_DCS_PARAM)),         // '<', '=', '>', '?'
+        FINAL(T(ACTION_IGNORE, STATE_DCS_PASSTHROUGH)), // 0x40 - 0x7E
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_DCS_PARAM] = {
+        C0(STAY(ACTION_IGNORE)),
+        R16(T(ACTION_COLLECT, STATE_DCS_INTERMEDIATE)), // 0x20 - 0x2F
+        R10(STAY(ACTION_PARAM)),                        // '0' - '9'
+        T(ACTION_IGNORE, STATE_DCS_IGNORE),             // ':'
+        STAY(ACTION_PARAM),                             // ';'
+        R4(T(ACTION_IGNORE, STATE_DCS_IGNORE)),         // '<', '=', '>', '?'
+        FINAL(T(ACTION_IGNORE, STATE_DCS_PASSTHROUGH)), // 0x40 - 0x7E
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_DCS_INTERMEDIATE] = {
+        C0(STAY(ACTION_IGNORE)),
+        R16(STAY(ACTION_COLLECT)),                      // 0x20 - 0x2F
+        R16(T(ACTION_IGNORE, STATE_DCS_IGNORE)),        // 0x30 - 0x3F
+        FINAL(T(ACTION_IGNORE, STATE_DCS_PASSTHROUGH)), // 0x40 - 0x7E
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_DCS_PASSTHROUGH] = {
+        C0(STAY(ACTION_PUT)),
+        GL(STAY(ACTION_PUT)),
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_PUT)                                // >= 0xA0
+    },
+    [STATE_DCS_IGNORE] = {
+        C0(STAY(ACTION_IGNORE)),
+        GL(STAY(ACTION_IGNORE)),
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    },
+    [STATE_SOS_PM_APC_STRING] = {
+        C0(STAY(ACTION_IGNORE)),
+        GL(STAY(ACTION_IGNORE)),
+        STAY(ACTION_IGNORE),                            // 0x7F
+        C1,
+        STAY(ACTION_IGNORE)                             // >= 0xA0
+    }
+};
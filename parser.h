@@ -0,0 +1,54 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+/*
+ * DEC/ANSI compatible parser state machine, based on:
+ * https://vt100.net/emu/dec_ansi_parser
+ *
+ * Every input character is looked up in vt_transitions by the current
+ * state, which gives the action to perform on it and the next state.
+ */
+
+// parser states
+#define STATE_GROUND                (0)
+#define STATE_ESCAPE                (1)
+#define STATE_ESCAPE_INTERMEDIATE   (2)
+#define STATE_CSI_ENTRY             (3)
+#define STATE_CSI_PARAM             (4)
+#define STATE_CSI_INTERMEDIATE      (5)
+#define STATE_CSI_IGNORE            (6)
+#define STATE_OSC_STRING            (7)
+#define STATE_DCS_ENTRY             (8)
+#define STATE_DCS_PARAM             (9)
+#define STATE_DCS_INTERMEDIATE      (10)
+#define STATE_DCS_PASSTHROUGH       (11)
+#define STATE_DCS_IGNORE            (12)
+#define STATE_SOS_PM_APC_STRING     (13)
+#define STATES_NUMBER               (14)
+
+// transitions into STATE_NONE stay in the current state
+// without running any exit/entry action.
+#define STATE_NONE                  (15)
+
+// parser actions
+#define ACTION_IGNORE               (0)
+#define ACTION_PRINT                (1)
+#define ACTION_EXECUTE              (2)
+#define ACTION_COLLECT              (3)
+#define ACTION_PARAM                (4)
+#define ACTION_ESC_DISPATCH         (5)
+#define ACTION_CSI_DISPATCH         (6)
+#define ACTION_PUT                  (7)
+#define ACTION_OSC_PUT              (8)
+#define ACTIONS_NUMBER              (9)
+
+// all characters above the C1 controls share the last column.
+#define PARSER_COLUMNS              (0xA1)
+#define PARSER_COLUMN(c)            ((c) < 0xA0 ? (c) : 0xA0)
+
+#define TRANSITION_ACTION(t)        ((t) & 0xF)
+#define TRANSITION_STATE(t)         ((t) >> 4)
+
+extern const unsigned char vt_transitions[STATES_NUMBER][PARSER_COLUMNS];
+
+#endif
@@ -0,0 +1,341 @@
+#include "record.h"
+#include "snapshot.h"
+#include "common.h"
+
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+
+static long long record_now(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000LL) + (ts.tv_nsec / 1000);
+}
+
+static int write_frame(FILE* file, unsigned char type, long long time, void* data, unsigned int length){
+    int ret = 0;
+
+    ret += fwrite(&type, sizeof(type), 1, file);
+    ret += fwrite(&time, sizeof(time), 1, file);
+    ret += fwrite(&length, sizeof(length), 1, file);
+    ASSERT((ret == 3), "failed to write frame header.\n");
+
+    if (length > 0){
+        ret = fwrite(data, length, 1, file);
+        ASSERT((ret == 1), "failed to write frame data.\n");
+    }
+    return 0;
+
+fail:
+    return -1;
+}
+
+// returns 1 at the end of the file (or on a frame cut by a crash).
+static int read_frame_header(FILE* file, TRecordFrame* frame){
+    int ret = 0;
+
+    ret += fread(&frame->type, sizeof(frame->type), 1, file);
+    ret += fread(&frame->time, sizeof(frame->time), 1, file);
+    ret += fread(&frame->length, sizeof(frame->length), 1, file);
+    if (ret != 3){
+        return 1;
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------
+// recorder
+// ------------------------------------------------------------
+
+static int record_keyframe(TRecorder* recorder, Terminal* terminal){
+    char* snapshot = NULL;
+    int len;
+    int ret;
+
+    ret = terminal_snapshot(terminal, &snapshot, &len);
+    ASSERT(ret == 0, "failed to snapshot terminal.\n");
+
+    ret = write_frame(  recorder->file,
+                        RECORD_FRAME_KEYFRAME,
+                        record_now() - recorder->start_time,
+                        snapshot,
+                        len);
+    free(snapshot);
+    ASSERT(ret == 0, "failed to write keyframe.\n");
+
+    recorder->bytes_since_keyframe = 0;
+    return 0;
+
+fail:
+    return -1;
+}
+
+TRecorder* record_create(char* path, Terminal* terminal){
+    TRecorder* recorder = NULL;
+    unsigned int header[2] = { RECORD_MAGIC, RECORD_VERSION };
+    int ret;
+
+    recorder = (TRecorder*) malloc(sizeof(TRecorder));
+    ASSERT(recorder, "failed to malloc() recorder.\n");
+    memset(recorder, 0, sizeof(TRecorder));
+
+    recorder->file = fopen(path, "wb");
+    ASSERT_TO(fail_on_file, recorder->file, "failed to open record file.\n");
+
+    ret = fwrite(header, sizeof(header), 1, recorder->file);
+    ASSERT_TO(fail_on_write, (ret == 1), "failed to write record header.\n");
+
+    recorder->start_time = record_now();
+
+    // so playback can start from the state the terminal was in.
+    ret = record_keyframe(recorder, terminal);
+    ASSERT_TO(fail_on_write, (ret == 0), "failed to write first keyframe.\n");
+
+    return recorder;
+
+fail_on_write:
+    fclose(recorder->file);
+fail_on_file:
+    free(recorder);
+fail:
+    return NULL;
+}
+
+void record_destroy(TRecorder* recorder){
+    ASSERT(recorder, "trying to destroy NULL recorder.\n");
+
+    fclose(recorder->file);
+    free(recorder);
+
+fail:
+    return;
+}
+
+int record_chunk(TRecorder* recorder, Terminal* terminal, char* buf, int len){
+    int ret;
+
+    if (recorder->bytes_since_keyframe >= RECORD_KEYFRAME_INTERVAL){
+        ret = record_keyframe(recorder, terminal);
+        ASSERT(ret == 0, "failed to record keyframe.\n");
+    }
+
+    ret = write_frame(  recorder->file,
+                        RECORD_FRAME_CHUNK,
+                        record_now() - recorder->start_time,
+                        buf,
+                        len);
+    ASSERT(ret == 0, "failed to record chunk.\n");
+
+    recorder->bytes_since_keyframe += len;
+
+    // keep the record usable if the terminal crashes.
+    fflush(recorder->file);
+    return 0;
+
+fail:
+    return -1;
+}
+
+int record_resize(TRecorder* recorder, int cols_number, int rows_number){
+    int size[2] = { cols_number, rows_number };
+    int ret;
+
+    ret = write_frame(  recorder->file,
+                        RECORD_FRAME_RESIZE,
+                        record_now() - recorder->start_time,
+                        size,
+                        sizeof(size));
+    ASSERT(ret == 0, "failed to record resize.\n");
+    return 0;
+
+fail:
+    return -1;
+}
+
+// ------------------------------------------------------------
+// player
+// ------------------------------------------------------------
+
+static int player_read_data(TPlayer* player, unsigned int length){
+    int ret;
+
+    if (length > player->buffer_size){
+        char* buffer = (char*) realloc(player->buffer, length);
+        ASSERT(buffer, "failed to realloc player buffer.\n");
+
+        player->buffer = buffer;
+        player->buffer_size = length;
+    }
+
+    if (length > 0){
+        ret = fread(player->buffer, length, 1, player->file);
+        ASSERT((ret == 1), "frame data is truncated.\n");
+    }
+    return 0;
+
+fail:
+    return -1;
+}
+
+TPlayer* player_create(char* path){
+    TPlayer* player = NULL;
+    TRecordFrame frame;
+    unsigned int header[2];
+    struct stat st;
+    long offset;
+    int ret;
+
+    player = (TPlayer*) malloc(sizeof(TPlayer));
+    ASSERT(player, "failed to malloc() player.\n");
+    memset(player, 0, sizeof(TPlayer));
+
+    player->file = fopen(path, "rb");
+    ASSERT_TO(fail_on_file, player->file, "failed to open record file.\n");
+
+    ret = fread(header, sizeof(header), 1, player->file);
+    ASSERT_TO(fail_on_read, (ret == 1), "failed to read record header.\n");
+    ASSERT_TO(fail_on_read, (header[0] == RECORD_MAGIC), "not a record file.\n");
+    ASSERT_TO(fail_on_read, (header[1] == RECORD_VERSION), "unsupported record version.\n");
+
+    ret = fstat(fileno(player->file), &st);
+    ASSERT_TO(fail_on_read, (ret == 0), "failed to stat record file.\n");
+
+    // index the keyframes, skipping over the data of every frame. a
+    // recording cut by a crash ends at the first frame it has not
+    // whole, fseek() would go past the end of the file.
+    while (1){
+        offset = ftell(player->file);
+
+        if (read_frame_header(player->file, &frame) != 0 ||
+            ftell(player->file) + (long long) frame.length > (long long) st.st_size ||
+            fseek(player->file, frame.length, SEEK_CUR) != 0){
+            break;
+        }
+
+        if (frame.type == RECORD_FRAME_KEYFRAME){
+            TRecordKeyframe* keyframes;
+
+            keyframes = (TRecordKeyframe*) realloc(player->keyframes,
+                                                   sizeof(TRecordKeyframe) * (player->keyframes_number + 1));
+            ASSERT_TO(fail_on_index, keyframes, "failed to realloc keyframes.\n");
+            player->keyframes = keyframes;
+
+            player->keyframes[player->keyframes_number].time = frame.time;
+            player->keyframes[player->keyframes_number].offset = offset;
+            player->keyframes_number++;
+        }
+        player->duration = frame.time;
+    }
+    ASSERT_TO(fail_on_index, (player->keyframes_number > 0), "record has no keyframes.\n");
+
+    player->offset = player->keyframes[0].offset;
+    return player;
+
+fail_on_index:
+    free(player->keyframes);
+fail_on_read:
+    fclose(player->file);
+fail_on_file:
+    free(player);
+fail:
+    return NULL;
+}
+
+void player_destroy(TPlayer* player){
+    ASSERT(player, "trying to destroy NULL player.\n");
+
+    fclose(player->file);
+    free(player->keyframes);
+    free(player->buffer);
+    free(player);
+
+fail:
+    return;
+}
+
+int player_step(TPlayer* player, Terminal* terminal, TRecordFrame* frame, char** data){
+    int ret;
+
+    fseek(player->file, player->offset, SEEK_SET);
+
+    if (read_frame_header(player->file, frame) != 0){
+        return 1;
+    }
+
+    ret = player_read_data(player, frame->length);
+    if (ret != 0){
+        // cut in the middle of a frame, play what was saved.
+        return 1;
+    }
+    player->offset = ftell(player->file);
+
+    switch (frame->type){
+        case RECORD_FRAME_CHUNK:
+            ret = terminal_push(terminal, player->buffer, frame->length);
+            ASSERT(ret == 0, "failed to push chunk.\n");
+            break;
+
+        case RECORD_FRAME_KEYFRAME:
+            ret = terminal_restore(terminal, player->buffer, frame->length);
+            ASSERT(ret == 0, "failed to restore keyframe.\n");
+            break;
+
+        case RECORD_FRAME_RESIZE:
+            ASSERT((frame->length == sizeof(int) * 2), "bad resize frame.\n");
+            ret = terminal_resize(  terminal,
+                                    ((int*) player->buffer)[0],
+                                    ((int*) player->buffer)[1]);
+            ASSERT(ret == 0, "failed to resize terminal.\n");
+            break;
+
+        default:
+            LOG("unknown frame type: %d\n", frame->type);
+            break;
+    }
+
+    *data = player->buffer;
+    return 0;
+
+fail:
+    return -1;
+}
+
+int player_seek(TPlayer* player, Terminal* terminal, long long time){
+    TRecordFrame frame;
+    char* data;
+    int i;
+    int ret;
+
+    // the nearest keyframe at or before the wanted time.
+    for (i = player->keyframes_number - 1; i > 0; i--){
+        if (player->keyframes[i].time <= time){
+            break;
+        }
+    }
+    player->offset = player->keyframes[i].offset;
+
+    // restore it and play only the tail.
+    while (1){
+        long offset = player->offset;
+
+        fseek(player->file, offset, SEEK_SET);
+        if (read_frame_header(player->file, &frame) != 0){
+            break;
+        }
+        if (frame.time > time && offset != player->keyframes[i].offset){
+            break;
+        }
+
+        ret = player_step(player, terminal, &frame, &data);
+        ASSERT((ret >= 0), "failed to play frame.\n");
+        if (ret == 1){
+            break;
+        }
+    }
+    return 0;
+
+fail:
+    return -1;
+}
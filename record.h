@@ -0,0 +1,81 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "terminal.h"
+
+#include <stdio.h>
+
+/*
+ * Session recording: every chunk read from the pty is logged with the
+ * time it was read, and a keyframe (terminal snapshot) is written
+ * every RECORD_KEYFRAME_INTERVAL bytes of input. A player seeks by
+ * restoring the nearest keyframe before the wanted time and pushing
+ * only the chunks after it.
+ *
+ * file: header, followed by frames of
+ *      type (1 byte) | time in microseconds (8 bytes) | length (4 bytes) | data
+ */
+
+#define RECORD_MAGIC                (0x43455254) // "TREC"
+#define RECORD_VERSION              (1)
+
+#define RECORD_KEYFRAME_INTERVAL    (256 * 1024)
+
+// frame types
+#define RECORD_FRAME_CHUNK          (1)
+#define RECORD_FRAME_KEYFRAME       (2)
+#define RECORD_FRAME_RESIZE         (3)
+
+typedef struct{
+    unsigned char type;
+    long long time;
+    unsigned int length;
+}TRecordFrame;
+
+typedef struct{
+    FILE* file;
+    long long start_time;
+    long long bytes_since_keyframe;
+}TRecorder;
+
+typedef struct{
+    long long time;
+    long offset;
+}TRecordKeyframe;
+
+typedef struct{
+    FILE* file;
+
+    long long duration;
+
+    TRecordKeyframe* keyframes;
+    int keyframes_number;
+
+    // the next frame to play.
+    long offset;
+
+    // data of the last played frame.
+    char* buffer;
+    unsigned int buffer_size;
+}TPlayer;
+
+
+TRecorder* record_create(char* path, Terminal* terminal);
+void record_destroy(TRecorder* recorder);
+
+// called with every chunk read from the pty, before it is pushed.
+int record_chunk(TRecorder* recorder, Terminal* terminal, char* buf, int len);
+int record_resize(TRecorder* recorder, int cols_number, int rows_number);
+
+
+TPlayer* player_create(char* path);
+void player_destroy(TPlayer* player);
+
+// brings the terminal to its state at the given time.
+int player_seek(TPlayer* player, Terminal* terminal, long long time);
+
+// plays the next frame, its data is valid until the next step.
+// returns 1 when there is nothing left to play.
+int player_step(TPlayer* player, Terminal* terminal, TRecordFrame* frame, char** data);
+
+#endif
@@ -0,0 +1,1476 @@
+#include "scrollback.h"
+#include "common.h"
+#include "utf8.h"
+#include "lz.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define SEGMENT_BYTES(segment)  (sizeof(TScrollbackSegment) + (segment)->size)
+
+// what an unreadable segment reads as.
+static TScrollbackLine empty_line = { NULL, 0 };
+
+static void scrollback_file_close(TScrollbackFile* file);
+
+static inline TScrollbackLine* scrollback_hot_line(TScrollback* scrollback, int i){
+    int index = scrollback->start + i;
+
+    if (index >= SCROLLBACK_HOT_MAX){
+        index -= SCROLLBACK_HOT_MAX;
+    }
+    return &scrollback->lines[index];
+}
+
+static inline TScrollbackSegment** scrollback_segment(TScrollback* scrollback, int i){
+    return &scrollback->segments[(scrollback->segments_start + i) % scrollback->segments_max];
+}
+
+static void scrollback_free_segment(TScrollbackSegment* segment){
+    if (segment == NULL){
+        return;
+    }
+    free(segment->data);
+    free(segment);
+}
+
+static int scrollback_reserve(TScrollback* scrollback, int buffer_size){
+    if (buffer_size > scrollback->buffer_size){
+        char* buffer = (char*) realloc(scrollback->buffer, buffer_size);
+        ASSERT(buffer, "failed to realloc scrollback buffer.\n");
+
+        scrollback->buffer = buffer;
+        scrollback->buffer_size = buffer_size;
+    }
+    return 0;
+
+fail:
+    return -1;
+}
+
+static int scrollback_allocate_segments(TScrollback* scrollback, int segments_max){
+    TScrollbackSegment** segments;
+    int i;
+
+    segments = (TScrollbackSegment**) calloc(segments_max, sizeof(TScrollbackSegment*));
+    ASSERT(segments, "failed to malloc scrollback segments.\n");
+
+    // the segments keep their order, the stale segments of the
+    // old ring (see scrollback_clear()) are freed on the way.
+    if (scrollback->segments){
+        for (i = 0; i < scrollback->segments_number; i++){
+            segments[i] = *scrollback_segment(scrollback, i);
+            *scrollback_segment(scrollback, i) = NULL;
+        }
+        for (i = 0; i < scrollback->segments_max; i++){
+            scrollback_free_segment(scrollback->segments[i]);
+        }
+        free(scrollback->segments);
+    }
+
+    scrollback->segments = segments;
+    scrollback->segments_max = segments_max;
+    scrollback->segments_start = 0;
+    return 0;
+
+fail:
+    return -1;
+}
+
+// room for every line when all but the hot ones are packed.
+static int scrollback_segments_max(int lines_max){
+    return (lines_max / SCROLLBACK_SEGMENT_LINES) + 2;
+}
+
+TScrollback* scrollback_create(int lines_max, size_t bytes_max, TStyleTable* styles, TClusterTable* clusters){
+    TScrollback* scrollback = NULL;
+    int ret;
+    int i;
+
+    scrollback = (TScrollback*) malloc(sizeof(TScrollback));
+    ASSERT(scrollback, "failed to malloc() scrollback.\n");
+    memset(scrollback, 0, sizeof(TScrollback));
+
+    scrollback->lines = (TScrollbackLine*) calloc(SCROLLBACK_HOT_MAX, sizeof(TScrollbackLine));
+    ASSERT_TO(fail_on_allocate, scrollback->lines, "failed to malloc scrollback lines.\n");
+
+    ret = scrollback_allocate_segments(scrollback, scrollback_segments_max(lines_max));
+    ASSERT_TO(fail_on_allocate, (ret == 0), "failed to allocate scrollback segments.\n");
+
+    for (i = 0; i < SCROLLBACK_CACHE_SEGMENTS; i++){
+        scrollback->cache[i].serial = -1;
+    }
+
+    scrollback->lines_max = lines_max;
+    scrollback->bytes_max = bytes_max;
+    scrollback->styles = styles;
+    scrollback->clusters = clusters;
+    return scrollback;
+
+fail_on_allocate:
+    free(scrollback->lines);
+    free(scrollback);
+fail:
+    return NULL;
+}
+
+void scrollback_destroy(TScrollback* scrollback){
+    int i;
+
+    ASSERT(scrollback, "trying to destroy NULL scrollback.\n");
+
+    // stale rows and segments included.
+    for (i = 0; i < SCROLLBACK_HOT_MAX; i++){
+        free(scrollback->lines[i].cells);
+    }
+    for (i = 0; i < scrollback->segments_max; i++){
+        scrollback_free_segment(scrollback->segments[i]);
+    }
+    for (i = 0; i < SCROLLBACK_CACHE_SEGMENTS; i++){
+        free(scrollback->cache[i].cells);
+    }
+    if (scrollback->file){
+        scrollback_file_close(scrollback->file);
+    }
+
+    free(scrollback->pending);
+    free(scrollback->lines);
+    free(scrollback->segments);
+    free(scrollback->buffer);
+    free(scrollback);
+
+fail:
+    return;
+}
+
+int scrollback_set_limits(TScrollback* scrollback, int lines_max, size_t bytes_max){
+    int ret;
+
+    ASSERT((lines_max >= 0), "bad scrollback lines limit.\n");
+
+    scrollback->lines_max = lines_max;
+    scrollback->bytes_max = bytes_max;
+    while (scrollback->lines_number > 0 &&
+           (scrollback->lines_number > lines_max || scrollback->bytes > bytes_max)){
+        scrollback_drop(scrollback, 1);
+    }
+
+    if (scrollback_segments_max(lines_max) != scrollback->segments_max){
+        ret = scrollback_allocate_segments(scrollback, scrollback_segments_max(lines_max));
+        ASSERT((ret == 0), "failed to resize scrollback.\n");
+    }
+    return 0;
+
+fail:
+    return -1;
+}
+
+// ------------------------------------------------------------
+// text
+// the characters of the cells in utf8, a cluster with all of its
+// codepoints. a character which would go on the cluster before it
+// (see cluster_extends()) starts with TEXT_BREAK.
+// ------------------------------------------------------------
+
+#define TEXT_BREAK  (0xFF) // never in utf8.
+
+/*
+ * Returns the size of the text of the cells, previous are the
+ * codepoints of the character before them (previous_length is 0
+ * if there is none), updated to those of the last cell.
+ */
+static int scrollback_encode_text(TClusterTable* clusters, TElement* cells, int length, char* text,
+                                  unsigned int** previous, int* previous_length){
+    unsigned int* last = *previous;
+    int last_length = *previous_length;
+    unsigned int* codes;
+    int codes_number;
+    int size = 0;
+    int i, x;
+
+    for (x = 0; x < length; x++){
+        unsigned int code = cells[x].character_code;
+
+        // nothing below the combining marks goes on anything.
+        if (code < 0x300){
+            if (code < 0x80){
+                text[size++] = code;
+            }else{
+                size += utf8_encode(code, &text[size]);
+            }
+            last = &cells[x].character_code;
+            last_length = 1;
+            continue;
+        }
+
+        codes_number = cluster_codes(clusters, &cells[x].character_code, &codes);
+        if (last_length > 0 && cluster_extends(last, last_length, codes[0])){
+            text[size++] = (char) TEXT_BREAK;
+        }
+        for (i = 0; i < codes_number; i++){
+            size += utf8_encode(codes[i], &text[size]);
+        }
+        last = codes;
+        last_length = codes_number;
+    }
+
+    *previous = last;
+    *previous_length = last_length;
+    return size;
+}
+
+// the text encoded by the scrollback, unlike the pty input a
+// sequence does not need to be validated.
+static inline int scrollback_decode_code(unsigned char* in, int len, int* ip, unsigned int* code){
+    int i = *ip;
+
+    if (in[i] < 0x80){
+        *code = in[i];
+        *ip = i + 1;
+    }else if (in[i] < 0xE0){
+        ASSERT((i + 2 <= len), "utf8 sequence is cut.\n");
+        *code = ((in[i] & 0x1F) << 6) | (in[i + 1] & 0x3F);
+        *ip = i + 2;
+    }else if (in[i] < 0xF0){
+        ASSERT((i + 3 <= len), "utf8 sequence is cut.\n");
+        *code = ((in[i] & 0x0F) << 12) | ((in[i + 1] & 0x3F) << 6) | (in[i + 2] & 0x3F);
+        *ip = i + 3;
+    }else{
+        ASSERT((i + 4 <= len), "utf8 sequence is cut.\n");
+        *code = ((in[i] & 0x07) << 18) | ((in[i + 1] & 0x3F) << 12) | 
+                ((in[i + 2] & 0x3F) << 6) | (in[i + 3] & 0x3F);
+        *ip = i + 4;
+    }
+    return 0;
+
+fail:
+    return -1;
+}
+
+/*
+ * The clusters are interned again, the table is grown but not
+ * collected from here (only the terminal knows which ids are used),
+ * a cluster which does not fit is cut to its first codepoint.
+ */
+static int scrollback_decode_text(TClusterTable* clusters, char* text, int len, 
+                                  TElement* cells, int cells_number){
+    unsigned char* in = (unsigned char*) text;
+    unsigned int codes[CLUSTER_CODES_MAX];
+    unsigned int code;
+    int codes_number;
+    int ip = 0;
+    int next;
+    int ret;
+    int i;
+
+    for (i = 0; i < cells_number; i++){
+        if (ip < len && in[ip] == TEXT_BREAK){
+            ip++;
+        }
+        if (ip >= len){
+            return -1;
+        }
+
+        ret = scrollback_decode_code(in, len, &ip, &codes[0]);
+        ASSERT((ret == 0), "bad scrollback text.\n");
+        codes_number = 1;
+
+        // a lead byte from 0xCC on is a codepoint from 0x300 on.
+        while (ip < len && in[ip] >= 0xCC && in[ip] != TEXT_BREAK && codes_number < CLUSTER_CODES_MAX){
+            next = ip;
+            ret = scrollback_decode_code(in, len, &next, &code);
+            ASSERT((ret == 0), "bad scrollback text.\n");
+
+            if (!cluster_extends(codes, codes_number, code)){
+                break;
+            }
+            codes[codes_number++] = code;
+            ip = next;
+        }
+
+        if (codes_number > 1){
+            int id = cluster_intern(clusters, codes, codes_number);
+
+            if (id < 0 && cluster_table_grow(clusters) == 0){
+                id = cluster_intern(clusters, codes, codes_number);
+            }
+            if (id >= 0){
+                codes[0] = ELEMENT_CLUSTER | id;
+            }
+        }
+
+        cells[i].character_code = codes[0];
+        cells[i].flags = 0;
+    }
+    return (ip == len) ? 0 : -1;
+
+fail:
+    return -1;
+}
+
+// ------------------------------------------------------------
+// segments
+// a segment is compressed from:
+//      the length of every line    varint each
+//      the size of the text        varint
+//      the text                    utf8, see above
+//      the style runs              varint length, TStyle each
+// ------------------------------------------------------------
+
+static inline int put_varint(char* buf, int offset, unsigned int value){
+    while (value >= 0x80){
+        buf[offset++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buf[offset++] = value;
+    return offset;
+}
+
+// returns -1 if the varint is cut.
+static inline int get_varint(char* buf, int* offset, int len){
+    unsigned int value = 0;
+    int shift = 0;
+    unsigned char byte;
+
+    do{
+        if (*offset >= len || shift > 28){
+            return -1;
+        }
+        byte = buf[(*offset)++];
+        value |= (byte & 0x7F) << shift;
+        shift += 7;
+    }while (byte & 0x80);
+
+    return value;
+}
+
+// the style is written out in full, so the segment does not pin its id.
+static int put_run(char* buf, int offset, int length, TStyle* style){
+    offset = put_varint(buf, offset, length);
+    memcpy(&buf[offset], style, sizeof(TStyle));
+    return offset + sizeof(TStyle);
+}
+
+// the id of the style interned again, the default one if it does not fit.
+static int scrollback_intern_style(TStyleTable* styles, TStyle* style){
+    int id;
+
+    // the table is grown but not collected from here, only the
+    // terminal knows which ids are used.
+    id = style_intern(styles, style);
+    if (id < 0 && style_table_grow(styles) == 0){
+        id = style_intern(styles, style);
+    }
+    return (id < 0) ? STYLE_DEFAULT : id;
+}
+
+/*
+ * Packs the oldest SCROLLBACK_SEGMENT_LINES unpacked lines into a new
+ * segment at the end of the segments ring.
+ */
+static int scrollback_pack(TScrollback* scrollback){
+    TScrollbackSegment* segment = NULL;
+    TScrollbackLine* line;
+    int cells_number = 0;
+    int raw_size = 0;
+    int text_size = 0;
+    int text_bound = 0;
+    int run_length = 0;
+    int run_style = -1;
+    int bound, size;
+    char* raw;
+    int ret;
+    int i, x;
+
+    ASSERT((scrollback->segments_number < scrollback->segments_max), "no room for a segment.\n");
+
+    for (i = 0; i < SCROLLBACK_SEGMENT_LINES; i++){
+        line = scrollback_hot_line(scrollback, i);
+        cells_number += line->length;
+
+        for (x = 0; x < line->length; x++){
+            if (line->cells[x].character_code & ELEMENT_CLUSTER){
+                text_bound += CLUSTER_UTF8_MAX;
+            }
+        }
+    }
+
+    // at most 5 bytes for every length, and 4 bytes of text (and a
+    // break) and a run of 17 bytes for every cell, but for the clusters.
+    bound = 5 + (5 * SCROLLBACK_SEGMENT_LINES) + (22 * cells_number) + text_bound;
+    ret = scrollback_reserve(scrollback, bound + LZ_BOUND(bound));
+    ASSERT((ret == 0), "failed to reserve scrollback buffer.\n");
+    raw = scrollback->buffer;
+
+    for (i = 0; i < SCROLLBACK_SEGMENT_LINES; i++){
+        raw_size = put_varint(raw, raw_size, scrollback_hot_line(scrollback, i)->length);
+    }
+
+    // the text goes after its size, which is known only at the end.
+    char* text = &raw[raw_size + 5];
+    unsigned int* previous = NULL;
+    int previous_length = 0;
+    int text_offset;
+    for (i = 0; i < SCROLLBACK_SEGMENT_LINES; i++){
+        line = scrollback_hot_line(scrollback, i);
+        text_size += scrollback_encode_text(scrollback->clusters, line->cells, line->length, 
+                                            &text[text_size], &previous, &previous_length);
+    }
+    raw_size = put_varint(raw, raw_size, text_size);
+    memmove(&raw[raw_size], text, text_size);
+    text_offset = raw_size;
+    raw_size += text_size;
+
+    for (i = 0; i < SCROLLBACK_SEGMENT_LINES; i++){
+        line = scrollback_hot_line(scrollback, i);
+        for (x = 0; x < line->length; x++){
+            unsigned short style = line->cells[x].style;
+
+            if (style == run_style){
+                run_length++;
+                continue;
+            }
+            if (run_length > 0){
+                raw_size = put_run(raw, raw_size, run_length, &scrollback->styles->styles[run_style]);
+            }
+            run_style = style;
+            run_length = 1;
+        }
+    }
+    if (run_length > 0){
+        raw_size = put_run(raw, raw_size, run_length, &scrollback->styles->styles[run_style]);
+    }
+
+    size = lz_compress(raw, raw_size, &scrollback->buffer[bound], LZ_BOUND(bound));
+    ASSERT((size >= 0), "failed to compress segment.\n");
+
+    segment = (TScrollbackSegment*) calloc(1, sizeof(TScrollbackSegment));
+    ASSERT(segment, "failed to malloc segment.\n");
+
+    segment->data = (char*) malloc(size > 0 ? size : 1);
+    ASSERT_TO(fail_on_segment, segment->data, "failed to malloc segment data.\n");
+    memcpy(segment->data, &scrollback->buffer[bound], size);
+
+    segment->serial = scrollback->next_serial++;
+    segment->size = size;
+    segment->raw_size = raw_size;
+    segment->cells_number = cells_number;
+
+    // the trigrams which span two lines only make the segment read by
+    // a few more searches. the spacers (0) and the breaks are skipped,
+    // as in the text of a line searched (see search.c).
+    trigram_filter_add(&segment->trigrams, &raw[text_offset], text_size);
+
+    // a stale segment, if the ring was cleared.
+    scrollback_free_segment(*scrollback_segment(scrollback, scrollback->segments_number));
+    *scrollback_segment(scrollback, scrollback->segments_number) = segment;
+    scrollback->segments_number++;
+    scrollback->bytes += SEGMENT_BYTES(segment);
+
+    // the packed lines leave the ring.
+    for (i = 0; i < SCROLLBACK_SEGMENT_LINES; i++){
+        line = scrollback_hot_line(scrollback, 0);
+
+        scrollback->bytes -= sizeof(TElement) * line->length;
+        free(line->cells);
+        line->cells = NULL;
+        line->length = 0;
+
+        scrollback->start = (scrollback->start + 1) % SCROLLBACK_HOT_MAX;
+        scrollback->hot_number--;
+    }
+    return 0;
+
+fail_on_segment:
+    scrollback_free_segment(segment);
+fail:
+    return -1;
+}
+
+// the segment unpacked in the cache, NULL if it can't be read.
+static TScrollbackCache* scrollback_unpack(TScrollback* scrollback, TScrollbackSegment* segment){
+    TScrollbackCache* cache = &scrollback->cache[0];
+    char* raw;
+    int offset = 0;
+    int cells = 0;
+    int length, text_size;
+    int ret;
+    int i;
+
+    for (i = 0; i < SCROLLBACK_CACHE_SEGMENTS; i++){
+        if (scrollback->cache[i].serial == segment->serial){
+            scrollback->cache[i].used = ++scrollback->clock;
+            return &scrollback->cache[i];
+        }
+        if (scrollback->cache[i].used < cache->used){
+            cache = &scrollback->cache[i];
+        }
+    }
+    cache->serial = -1;
+
+    ret = scrollback_reserve(scrollback, segment->raw_size);
+    ASSERT((ret == 0), "failed to reserve scrollback buffer.\n");
+    raw = scrollback->buffer;
+
+    if (segment->cells_number > cache->cells_capacity){
+        TElement* new_cells = (TElement*) realloc(cache->cells, sizeof(TElement) * segment->cells_number);
+        ASSERT(new_cells, "failed to realloc cache cells.\n");
+
+        cache->cells = new_cells;
+        cache->cells_capacity = segment->cells_number;
+    }
+
+    ret = lz_decompress(segment->data, segment->size, raw, segment->raw_size);
+    ASSERT((ret == segment->raw_size), "failed to decompress segment.\n");
+
+    for (i = 0; i < SCROLLBACK_SEGMENT_LINES; i++){
+        length = get_varint(raw, &offset, segment->raw_size);
+        ASSERT((length >= 0 && cells + length <= segment->cells_number), "bad segment line length.\n");
+
+        cache->lines[i].cells = length ? &cache->cells[cells] : NULL;
+        cache->lines[i].length = length;
+        cells += length;
+    }
+
+    text_size = get_varint(raw, &offset, segment->raw_size);
+    ASSERT((text_size >= 0 && offset + text_size <= segment->raw_size), "bad segment text size.\n");
+
+    ret = scrollback_decode_text(scrollback->clusters, &raw[offset], text_size, cache->cells, segment->cells_number);
+    ASSERT((ret == 0), "bad segment text.\n");
+    offset += text_size;
+
+    for (cells = 0; cells < segment->cells_number; cells += length){
+        TStyle style;
+        int id;
+
+        length = get_varint(raw, &offset, segment->raw_size);
+        ASSERT((length > 0 && cells + length <= segment->cells_number), "bad segment run.\n");
+        ASSERT((offset + (int) sizeof(TStyle) <= segment->raw_size), "segment run is cut.\n");
+
+        memcpy(&style, &raw[offset], sizeof(TStyle));
+        offset += sizeof(TStyle);
+
+        id = scrollback_intern_style(scrollback->styles, &style);
+        for (i = cells; i < cells + length; i++){
+            cache->cells[i].style = id;
+        }
+    }
+
+    cache->serial = segment->serial;
+    cache->used = ++scrollback->clock;
+    scrollback->unpacks_number++;
+    return cache;
+
+fail:
+    return NULL;
+}
+
+// ------------------------------------------------------------
+// file
+// a record is:
+//      the size of the rest        4 bytes
+//      the length of the line      varint
+//      the size of the text        varint
+//      the text                    utf8, see above
+//      the style runs              varint length, TStyle each
+// ------------------------------------------------------------
+
+#define FILE_HEADER(file) ((TScrollbackFileHeader*) (file)->map)
+
+/*
+ * Maps the file at its new size, which it is grown to. The space is
+ * allocated rather than left sparse, so a full disk fails here instead
+ * of raising SIGBUS on a write to the map.
+ */
+static int scrollback_file_map(int fd, char** map, size_t* map_size, size_t size){
+    char* new_map;
+    int ret;
+
+    ret = posix_fallocate(fd, 0, size);
+    ASSERT((ret == 0), "failed to allocate scrollback file.\n");
+
+    new_map = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT((new_map != MAP_FAILED), "failed to map scrollback file.\n");
+
+    if (*map){
+        munmap(*map, *map_size);
+    }
+    *map = new_map;
+    *map_size = size;
+    return 0;
+
+fail:
+    return -1;
+}
+
+// room for lines_number lines in the index.
+static int scrollback_file_reserve_index(TScrollbackFile* file, int lines_number){
+    size_t size = file->index_size;
+    char* map = (char*) file->index;
+    int ret;
+
+    if ((size_t) lines_number * sizeof(unsigned long long) <= size){
+        return 0;
+    }
+
+    while ((size_t) lines_number * sizeof(unsigned long long) > size){
+        size += SCROLLBACK_FILE_GROW;
+    }
+    ret = scrollback_file_map(file->index_fd, &map, &file->index_size, size);
+    ASSERT((ret == 0), "failed to grow scrollback index.\n");
+
+    file->index = (unsigned long long*) map;
+    return 0;
+
+fail:
+    return -1;
+}
+
+/*
+ * Indexes the complete records, whatever is past the last one was cut
+ * by a crash and is written over.
+ */
+static int scrollback_file_recover(TScrollbackFile* file){
+    TScrollbackFileHeader* header = FILE_HEADER(file);
+    unsigned long long offset = sizeof(TScrollbackFileHeader);
+    unsigned long long end = header->size;
+    unsigned int size;
+    int lines_number = 0;
+    int ret;
+
+    if (end > file->map_size){
+        end = file->map_size;
+    }
+
+    while (offset + sizeof(size) <= end){
+        memcpy(&size, &file->map[offset], sizeof(size));
+        if (size == 0 || offset + sizeof(size) + size > end){
+            break;
+        }
+
+        ret = scrollback_file_reserve_index(file, lines_number + 1);
+        ASSERT((ret == 0), "failed to index scrollback file.\n");
+
+        file->index[lines_number++] = offset;
+        offset += sizeof(size) + size;
+    }
+
+    if (lines_number != header->lines_number || offset != header->size){
+        LOG_ERROR("scrollback file was cut, recovered %d lines.\n", lines_number);
+    }
+
+    header->size = offset;
+    header->lines_number = lines_number;
+    if (header->first_line > (unsigned long long) lines_number){
+        header->first_line = lines_number;
+    }
+
+    file->lines_number = lines_number;
+    file->first_line = header->first_line;
+    return 0;
+
+fail:
+    return -1;
+}
+
+static TScrollbackFile* scrollback_file_open(char* path, TStyleTable* styles, TClusterTable* clusters){
+    TScrollbackFile* file = NULL;
+    TScrollbackFileHeader* header;
+    char* index_path = NULL;
+    int directory_length;
+    struct stat st;
+    size_t size;
+    int ret;
+
+    file = (TScrollbackFile*) calloc(1, sizeof(TScrollbackFile));
+    ASSERT(file, "failed to malloc scrollback file.\n");
+    file->styles = styles;
+    file->clusters = clusters;
+    file->index_fd = -1;
+
+    file->fd = open(path, O_RDWR | O_CREAT, 0600);
+    ASSERT_TO(fail_on_open, (file->fd >= 0), "failed to open scrollback file %s.\n", path);
+
+    // a single terminal appends to the file and owns its index, the
+    // lock goes with the descriptor.
+    ret = flock(file->fd, LOCK_EX | LOCK_NB);
+    ASSERT_TO(fail_on_file, (ret == 0), "scrollback file %s is used by another terminal.\n", path);
+
+    ret = fstat(file->fd, &st);
+    ASSERT_TO(fail_on_file, (ret == 0), "failed to stat scrollback file.\n");
+
+    size = st.st_size;
+    ASSERT_TO(fail_on_file, (size == 0 || size >= sizeof(TScrollbackFileHeader)),
+              "%s is not a scrollback file.\n", path);
+    if (size == 0){
+        size = SCROLLBACK_FILE_GROW;
+    }
+    ret = scrollback_file_map(file->fd, &file->map, &file->map_size, size);
+    ASSERT_TO(fail_on_file, (ret == 0), "failed to map scrollback file.\n");
+
+    header = FILE_HEADER(file);
+    if (st.st_size == 0){
+        memset(header, 0, sizeof(TScrollbackFileHeader));
+        header->magic = SCROLLBACK_FILE_MAGIC;
+        header->version = SCROLLBACK_FILE_VERSION;
+        header->size = sizeof(TScrollbackFileHeader);
+    }
+    ASSERT_TO(fail_on_file, (header->magic == SCROLLBACK_FILE_MAGIC &&
+                             header->version == SCROLLBACK_FILE_VERSION),
+              "%s is not a scrollback file.\n", path);
+
+    // the index lives only as long as the file is open, in a file of
+    // its own name next to it (so on the same file system) which is
+    // unlinked right away.
+    directory_length = strrchr(path, '/') ? strrchr(path, '/') - path + 1 : 0;
+    index_path = (char*) malloc(directory_length + sizeof(SCROLLBACK_INDEX_TEMPLATE));
+    ASSERT_TO(fail_on_file, index_path, "failed to malloc index path.\n");
+    memcpy(index_path, path, directory_length);
+    strcpy(&index_path[directory_length], SCROLLBACK_INDEX_TEMPLATE);
+
+    file->index_fd = mkstemp(index_path);
+    ASSERT_TO(fail_on_file, (file->index_fd >= 0), "failed to open scrollback index.\n");
+    unlink(index_path);
+
+    ret = scrollback_file_recover(file);
+    ASSERT_TO(fail_on_file, (ret == 0), "failed to recover scrollback file.\n");
+
+    free(index_path);
+    return file;
+
+fail_on_file:
+    free(index_path);
+    scrollback_file_close(file);
+    return NULL;
+fail_on_open:
+    free(file);
+fail:
+    return NULL;
+}
+
+static void scrollback_file_close(TScrollbackFile* file){
+    if (file->map){
+        TScrollbackFileHeader header = *FILE_HEADER(file);
+
+        // the room grown for the next records is given back, unless
+        // the file turned out not to be a scrollback file.
+        munmap(file->map, file->map_size);
+        if (header.magic == SCROLLBACK_FILE_MAGIC && ftruncate(file->fd, header.size) != 0){
+            LOG_ERROR("failed to cut scrollback file.\n");
+        }
+    }
+    if (file->index){
+        munmap(file->index, file->index_size);
+    }
+    if (file->index_fd >= 0){
+        close(file->index_fd);
+    }
+    close(file->fd);
+
+    free(file->blocks);
+    free(file->line.cells);
+    free(file);
+}
+
+static int scrollback_file_append(TScrollbackFile* file, TElement* cells, int length){
+    TScrollbackFileHeader* header = FILE_HEADER(file);
+    unsigned long long offset = header->size;
+    unsigned int size = 0;
+    int run_length = 0;
+    int run_style = -1;
+    size_t bound;
+    unsigned int* previous = NULL;
+    int previous_length = 0;
+    int text_size = 0;
+    char* record;
+    char* text;
+    int ret;
+    int x;
+
+    ASSERT((file->lines_number < 0x7FFFFFFF), "scrollback file is full.\n");
+
+    // at most 5 bytes for every varint, and 4 bytes of text (and a
+    // break) and a run of 17 bytes for every cell, but for the clusters.
+    bound = sizeof(size) + 10 + (22 * (size_t) length);
+    for (x = 0; x < length; x++){
+        if (cells[x].character_code & ELEMENT_CLUSTER){
+            bound += CLUSTER_UTF8_MAX;
+        }
+    }
+    if (offset + bound > file->map_size){
+        size_t map_size = file->map_size;
+
+        while (offset + bound > map_size){
+            map_size += SCROLLBACK_FILE_GROW;
+        }
+        ret = scrollback_file_map(file->fd, &file->map, &file->map_size, map_size);
+        ASSERT((ret == 0), "failed to grow scrollback file.\n");
+        header = FILE_HEADER(file);
+    }
+
+    ret = scrollback_file_reserve_index(file, file->lines_number + 1);
+    ASSERT((ret == 0), "failed to grow scrollback index.\n");
+
+    record = &file->map[offset + sizeof(size)];
+    size = put_varint(record, 0, length);
+
+    // the text goes after its size, which is known only at the end.
+    text = &record[size + 5];
+    text_size = scrollback_encode_text(file->clusters, cells, length, text, &previous, &previous_length);
+    size = put_varint(record, size, text_size);
+    memmove(&record[size], text, text_size);
+    size += text_size;
+
+    for (x = 0; x <= length; x++){
+        if (x < length && cells[x].style == run_style){
+            run_length++;
+            continue;
+        }
+        if (run_length > 0){
+            size = put_varint(record, size, run_length);
+            memcpy(&record[size], &file->styles->styles[run_style], sizeof(TStyle));
+            size += sizeof(TStyle);
+        }
+        if (x < length){
+            run_style = cells[x].style;
+            run_length = 1;
+        }
+    }
+
+    // the record counts once it is complete.
+    memcpy(&file->map[offset], &size, sizeof(size));
+    file->index[file->lines_number++] = offset;
+    header->size = offset + sizeof(size) + size;
+    header->lines_number = file->lines_number;
+    return 0;
+
+fail:
+    return -1;
+}
+
+// i counts from the first line which was not cleared.
+static TScrollbackLine* scrollback_file_line(TScrollbackFile* file, int i){
+    TScrollbackLine* line = &file->line;
+    unsigned long long offset = file->index[file->first_line + i];
+    unsigned int size;
+    char* record;
+    int position = 0;
+    int length, text_size;
+    int cells = 0;
+    int ret;
+
+    memcpy(&size, &file->map[offset], sizeof(size));
+    record = &file->map[offset + sizeof(size)];
+
+    length = get_varint(record, &position, size);
+    ASSERT((length >= 0), "bad scrollback file line length.\n");
+
+    if (length > file->cells_capacity){
+        TElement* new_cells = (TElement*) realloc(line->cells, sizeof(TElement) * length);
+        ASSERT(new_cells, "failed to realloc scrollback file line.\n");
+
+        line->cells = new_cells;
+        file->cells_capacity = length;
+    }
+    line->length = 0;
+
+    text_size = get_varint(record, &position, size);
+    ASSERT((text_size >= 0 && position + text_size <= size), "bad scrollback file text size.\n");
+
+    ret = scrollback_decode_text(file->clusters, &record[position], text_size, line->cells, length);
+    ASSERT((ret == 0), "bad scrollback file text.\n");
+    position += text_size;
+
+    while (cells < length){
+        TStyle style;
+        int run_length;
+        int id;
+        int x;
+
+        run_length = get_varint(record, &position, size);
+        ASSERT((run_length > 0 && cells + run_length <= length), "bad scrollback file run.\n");
+        ASSERT((position + sizeof(TStyle) <= size), "scrollback file run is cut.\n");
+
+        memcpy(&style, &record[position], sizeof(TStyle));
+        position += sizeof(TStyle);
+
+        id = scrollback_intern_style(file->styles, &style);
+
+        for (x = cells; x < cells + run_length; x++){
+            line->cells[x].style = id;
+        }
+        cells += run_length;
+    }
+
+    line->length = length;
+    return line;
+
+fail:
+    return &empty_line;
+}
+
+// the length of line i without reading it.
+static int scrollback_file_line_length(TScrollbackFile* file, int i){
+    unsigned long long offset = file->index[file->first_line + i];
+    unsigned int size;
+    int position = 0;
+    int length;
+
+    memcpy(&size, &file->map[offset], sizeof(size));
+    length = get_varint(&file->map[offset + sizeof(size)], &position, size);
+    return length < 0 ? 0 : length;
+}
+
+int scrollback_open_file(TScrollback* scrollback, char* path, TStyleTable* styles){
+    TScrollbackFile* file;
+
+    file = scrollback_file_open(path, styles, scrollback->clusters);
+    ASSERT(file, "failed to open scrollback file.\n");
+
+    if (scrollback->file){
+        scrollback_file_close(scrollback->file);
+    }
+    scrollback_clear(scrollback);
+    scrollback->file = file;
+    return 0;
+
+fail:
+    return -1;
+}
+
+// ------------------------------------------------------------
+
+// the cells the pending line may grow to, it is cut past them.
+static int scrollback_pending_max(TScrollback* scrollback){
+    size_t cells_max = scrollback->bytes_max / sizeof(TElement);
+
+    return (cells_max < SCROLLBACK_PENDING_MAX) ? (int) cells_max : SCROLLBACK_PENDING_MAX;
+}
+
+// appends the row to the pending line.
+static int scrollback_join(TScrollback* scrollback, TElement* cells, int length){
+    int capacity = scrollback->pending_capacity;
+
+    // the first row becomes the line.
+    if (scrollback->pending_length == 0 && length > 0){
+        free(scrollback->pending);
+        scrollback->pending = cells;
+        scrollback->pending_length = length;
+        scrollback->pending_capacity = length;
+        scrollback->bytes += sizeof(TElement) * length;
+        return 0;
+    }
+
+    if (scrollback->pending_length + length > capacity){
+        TElement* pending;
+
+        while (scrollback->pending_length + length > capacity){
+            capacity = capacity ? capacity * 2 : length;
+        }
+        pending = (TElement*) realloc(scrollback->pending, sizeof(TElement) * capacity);
+        ASSERT(pending, "failed to realloc pending line.\n");
+
+        scrollback->pending = pending;
+        scrollback->pending_capacity = capacity;
+    }
+
+    if (length > 0){
+        memcpy(&scrollback->pending[scrollback->pending_length], cells, sizeof(TElement) * length);
+        scrollback->pending_length += length;
+        scrollback->bytes += sizeof(TElement) * length;
+    }
+    free(cells);
+    return 0;
+
+fail:
+    free(cells);
+    return -1;
+}
+
+// the line is complete, it goes after the others.
+static int scrollback_push_line(TScrollback* scrollback, TElement* cells, int length){
+    TScrollbackLine* line;
+    size_t bytes = sizeof(TElement) * length;
+    int ret;
+
+    if (scrollback->file){
+        ret = scrollback_file_append(scrollback->file, cells, length);
+        if (ret != 0){
+            // the lines in memory would no longer be the last ones of the file.
+            LOG_ERROR("failed to append to scrollback file, closing it.\n");
+            scrollback_file_close(scrollback->file);
+            scrollback->file = NULL;
+        }
+    }
+
+    if (scrollback->lines_max == 0 || bytes > scrollback->bytes_max){
+        free(cells);
+        return 0;
+    }
+
+    while (scrollback->lines_number > 0 &&
+           (scrollback->lines_number >= scrollback->lines_max ||
+            scrollback->bytes + bytes > scrollback->bytes_max)){
+        scrollback_drop(scrollback, 1);
+    }
+
+    if (scrollback->hot_number == SCROLLBACK_HOT_MAX){
+        ret = scrollback_pack(scrollback);
+        if (ret != 0){
+            // the history is lost rather than the new line.
+            LOG_ERROR("failed to pack scrollback segment.\n");
+            scrollback_drop(scrollback, scrollback->lines_number - scrollback->hot_number + SCROLLBACK_SEGMENT_LINES);
+        }
+    }
+
+    // shrinking is done in place by the allocator.
+    if (length == 0){
+        free(cells);
+        cells = NULL;
+    }else{
+        TElement* trimmed = (TElement*) realloc(cells, bytes);
+
+        if (trimmed){
+            cells = trimmed;
+        }
+    }
+
+    line = scrollback_hot_line(scrollback, scrollback->hot_number);
+    free(line->cells); // a stale row, if the ring was cleared.
+    line->cells = cells;
+    line->length = length;
+
+    scrollback->hot_number++;
+    scrollback->lines_number++;
+    scrollback->bytes += bytes;
+    return 0;
+}
+
+int scrollback_push(TScrollback* scrollback, TElement* cells, int length, int wrapped){
+    TElement* pending;
+    int pending_length;
+    int ret;
+
+    if (wrapped || scrollback->pending_length > 0){
+        // a line which goes on and on (a stream without a newline) is
+        // cut, what it has so far is pushed as a line of its own.
+        if (scrollback->pending_length > 0 &&
+            scrollback->pending_length + length > scrollback_pending_max(scrollback)){
+            pending = scrollback_take_pending(scrollback, &pending_length);
+            scrollback_push_line(scrollback, pending, pending_length);
+        }
+
+        ret = scrollback_join(scrollback, cells, length);
+        if (ret != 0){
+            free(scrollback_take_pending(scrollback, &pending_length));
+            return -1;
+        }
+        if (wrapped){
+            return 0;
+        }
+
+        // the last row, the pending line is pushed as is.
+        cells = scrollback_take_pending(scrollback, &length);
+    }
+    return scrollback_push_line(scrollback, cells, length);
+}
+
+int scrollback_pack_lines(TScrollback* scrollback){
+    int ret;
+
+    while (scrollback->hot_number >= SCROLLBACK_SEGMENT_LINES &&
+           scrollback->segments_number < scrollback->segments_max){
+        ret = scrollback_pack(scrollback);
+        ASSERT((ret == 0), "failed to pack scrollback segment.\n");
+    }
+    return 0;
+
+fail:
+    return -1;
+}
+
+TScrollbackLine* scrollback_line(TScrollback* scrollback, int i){
+    TScrollbackCache* cache;
+    int packed = (scrollback->segments_number * SCROLLBACK_SEGMENT_LINES) - scrollback->skipped;
+
+    // the lines in memory are the last ones of the file.
+    if (scrollback->file){
+        int dropped = scrollback_lines_number(scrollback) - scrollback->lines_number;
+
+        if (i < dropped){
+            return scrollback_file_line(scrollback->file, i);
+        }
+        i -= dropped;
+    }
+
+    if (i >= packed){
+        return scrollback_hot_line(scrollback, i - packed);
+    }
+
+    i += scrollback->skipped;
+    cache = scrollback_unpack(scrollback, *scrollback_segment(scrollback, i / SCROLLBACK_SEGMENT_LINES));
+    if (cache == NULL){
+        return &empty_line;
+    }
+    return &cache->lines[i % SCROLLBACK_SEGMENT_LINES];
+}
+
+int scrollback_previous_candidate(TScrollback* scrollback, unsigned int* hashes, int hashes_number, int i){
+    int packed = (scrollback->segments_number * SCROLLBACK_SEGMENT_LINES) - scrollback->skipped;
+    int dropped = 0;
+    int s;
+
+    if (scrollback->file){
+        dropped = scrollback_lines_number(scrollback) - scrollback->lines_number;
+    }
+
+    if (hashes_number == 0 || i < dropped || i >= dropped + packed){
+        return i;
+    }
+
+    s = (i - dropped + scrollback->skipped) / SCROLLBACK_SEGMENT_LINES;
+    if (trigram_filter_test(&(*scrollback_segment(scrollback, s))->trigrams, hashes, hashes_number)){
+        return i;
+    }
+
+    // the last line of the newest segment before which may have them.
+    for (s--; s >= 0; s--){
+        if (trigram_filter_test(&(*scrollback_segment(scrollback, s))->trigrams, hashes, hashes_number)){
+            return dropped + ((s + 1) * SCROLLBACK_SEGMENT_LINES) - scrollback->skipped - 1;
+        }
+    }
+    return dropped - 1;
+}
+
+TElement* scrollback_take_pending(TScrollback* scrollback, int* length){
+    TElement* pending = scrollback->pending;
+
+    *length = scrollback->pending_length;
+    if (*length == 0){
+        return NULL;
+    }
+
+    scrollback->pending = NULL;
+    scrollback->pending_length = 0;
+    scrollback->pending_capacity = 0;
+    scrollback->bytes -= sizeof(TElement) * (*length);
+    return pending;
+}
+
+/*
+ * The cells of the row at offset of a line cut at width, one less when
+ * the last one would be the left half of a wide character, which goes
+ * on the next row as it does on the screen.
+ */
+static int scrollback_view_count(TElement* cells, int length, int offset, int width){
+    int count = (length - offset < width) ? length - offset : width;
+
+    if (count == width && width > 1 && offset + count < length &&
+        cells[offset + count].character_code == ELEMENT_SPACER){
+        count--;
+    }
+    return count;
+}
+
+// the rows the line takes at width, at least one.
+static int scrollback_view_rows(TElement* cells, int length, int width){
+    int offset = 0;
+    int rows = 0;
+
+    if (length <= width){
+        return 1;
+    }
+    while (offset < length){
+        offset += scrollback_view_count(cells, length, offset, width);
+        rows++;
+    }
+    return rows;
+}
+
+// row (counted from the bottom) of the line cut at width.
+static TScrollbackLine* scrollback_view_cut(TScrollback* scrollback, TElement* cells, int length, 
+                                            int width, int row){
+    int rows = scrollback_view_rows(cells, length, width);
+    int offset = 0;
+    int i;
+
+    for (i = 0; i < rows - 1 - row; i++){
+        offset += scrollback_view_count(cells, length, offset, width);
+    }
+
+    scrollback->view.cells = cells ? &cells[offset] : NULL;
+    scrollback->view.length = (length > 0) ? scrollback_view_count(cells, length, offset, width) : 0;
+    return &scrollback->view;
+}
+
+// the rows line i takes at width, only a line longer than a row is read,
+// to find its wide characters.
+static int scrollback_file_view_rows(TScrollbackFile* file, int i, int width){
+    TScrollbackLine* line;
+
+    if (scrollback_file_line_length(file, i) <= width){
+        return 1;
+    }
+    line = scrollback_file_line(file, i);
+    return line ? scrollback_view_rows(line->cells, line->length, width) : 1;
+}
+
+/*
+ * The rows of the lines of block b at width, counted once per width. i
+ * is the first line of the block, counted as scrollback_file_line()
+ * does, the whole block must not be cleared.
+ */
+static int scrollback_file_block_rows(TScrollbackFile* file, int b, int i, int width){
+    TScrollbackFileBlock* block = NULL;
+    int rows = 0;
+    int j;
+
+    if (b >= file->blocks_number){
+        TScrollbackFileBlock* blocks;
+        int blocks_number = file->lines_number / SCROLLBACK_FILE_BLOCK_LINES + 1;
+
+        blocks = (TScrollbackFileBlock*) realloc(file->blocks, sizeof(TScrollbackFileBlock) * blocks_number);
+        if (blocks){
+            memset(&blocks[file->blocks_number], 0, 
+                   sizeof(TScrollbackFileBlock) * (blocks_number - file->blocks_number));
+            file->blocks = blocks;
+            file->blocks_number = blocks_number;
+        }
+    }
+    if (b < file->blocks_number){
+        block = &file->blocks[b];
+        if (block->view_width == width){
+            return block->view_rows;
+        }
+    }
+
+    for (j = i; j < i + SCROLLBACK_FILE_BLOCK_LINES; j++){
+        rows += scrollback_file_view_rows(file, j, width);
+    }
+    if (block){
+        block->view_width = width;
+        block->view_rows = rows;
+    }
+    return rows;
+}
+
+TScrollbackLine* scrollback_view_row(TScrollback* scrollback, int width, int row){
+    TScrollbackSegment* segment;
+    TScrollbackCache* cache;
+    TScrollbackLine* line;
+    int rows;
+    int i, s, first;
+
+    if (width <= 0 || row < 0){
+        return NULL;
+    }
+
+    if (scrollback->pending_length > 0){
+        rows = scrollback_view_rows(scrollback->pending, scrollback->pending_length, width);
+        if (row < rows){
+            return scrollback_view_cut(scrollback, scrollback->pending, scrollback->pending_length, width, row);
+        }
+        row -= rows;
+    }
+
+    for (i = scrollback->hot_number - 1; i >= 0; i--){
+        line = scrollback_hot_line(scrollback, i);
+        rows = scrollback_view_rows(line->cells, line->length, width);
+        if (row < rows){
+            return scrollback_view_cut(scrollback, line->cells, line->length, width, row);
+        }
+        row -= rows;
+    }
+
+    for (s = scrollback->segments_number - 1; s >= 0; s--){
+        segment = *scrollback_segment(scrollback, s);
+        first = (s == 0) ? scrollback->skipped : 0;
+
+        // counted once per width, unless some lines were dropped.
+        if (segment->view_width != width || first > 0){
+            cache = scrollback_unpack(scrollback, segment);
+            if (cache == NULL){
+                continue;
+            }
+
+            rows = 0;
+            for (i = first; i < SCROLLBACK_SEGMENT_LINES; i++){
+                rows += scrollback_view_rows(cache->lines[i].cells, cache->lines[i].length, width);
+            }
+            if (first == 0){
+                segment->view_width = width;
+                segment->view_rows = rows;
+            }
+        }else{
+            rows = segment->view_rows;
+        }
+
+        if (row >= rows){
+            row -= rows;
+            continue;
+        }
+
+        cache = scrollback_unpack(scrollback, segment);
+        if (cache == NULL){
+            return &empty_line;
+        }
+        for (i = SCROLLBACK_SEGMENT_LINES - 1; i >= first; i--){
+            line = &cache->lines[i];
+            rows = scrollback_view_rows(line->cells, line->length, width);
+            if (row < rows){
+                return scrollback_view_cut(scrollback, line->cells, line->length, width, row);
+            }
+            row -= rows;
+        }
+    }
+
+    // the lines dropped from memory but kept in the file, a whole block
+    // at a time by its count of rows.
+    if (scrollback->file){
+        TScrollbackFile* file = scrollback->file;
+
+        i = scrollback_lines_number(scrollback) - scrollback->lines_number - 1;
+        while (i >= 0){
+            int last = file->first_line + i;
+
+            if (last % SCROLLBACK_FILE_BLOCK_LINES == SCROLLBACK_FILE_BLOCK_LINES - 1 &&
+                i >= SCROLLBACK_FILE_BLOCK_LINES - 1){
+                rows = scrollback_file_block_rows(file, last / SCROLLBACK_FILE_BLOCK_LINES,
+                                                  i - (SCROLLBACK_FILE_BLOCK_LINES - 1), width);
+                if (row >= rows){
+                    row -= rows;
+                    i -= SCROLLBACK_FILE_BLOCK_LINES;
+                    continue;
+                }
+            }
+
+            rows = scrollback_file_view_rows(file, i, width);
+            if (row < rows){
+                line = scrollback_file_line(file, i);
+                if (line == NULL){
+                    return &empty_line;
+                }
+                return scrollback_view_cut(scrollback, line->cells, line->length, width, row);
+            }
+            row -= rows;
+            i--;
+        }
+    }
+    return NULL;
+}
+
+void scrollback_drop(TScrollback* scrollback, int lines_number){
+    TScrollbackSegment** segment;
+    TScrollbackLine* line;
+    int count;
+
+    while (lines_number > 0 && scrollback->lines_number > 0){
+        // the packed lines are the oldest.
+        if (scrollback->segments_number > 0){
+            count = SCROLLBACK_SEGMENT_LINES - scrollback->skipped;
+            if (count > lines_number){
+                count = lines_number;
+            }
+            scrollback->skipped += count;
+            scrollback->lines_number -= count;
+            lines_number -= count;
+
+            if (scrollback->skipped == SCROLLBACK_SEGMENT_LINES){
+                segment = scrollback_segment(scrollback, 0);
+
+                scrollback->bytes -= SEGMENT_BYTES(*segment);
+                scrollback_free_segment(*segment);
+                *segment = NULL;
+
+                scrollback->segments_start = (scrollback->segments_start + 1) % scrollback->segments_max;
+                scrollback->segments_number--;
+                scrollback->skipped = 0;
+            }
+            continue;
+        }
+
+        line = scrollback_hot_line(scrollback, 0);
+
+        scrollback->bytes -= sizeof(TElement) * line->length;
+        free(line->cells);
+        line->cells = NULL;
+        line->length = 0;
+
+        scrollback->start = (scrollback->start + 1) % SCROLLBACK_HOT_MAX;
+        scrollback->hot_number--;
+        scrollback->lines_number--;
+        lines_number--;
+    }
+}
+
+void scrollback_clear(TScrollback* scrollback){
+    // the rows and segments stay in their slots past the end of the
+    // rings until they are reused, so nothing is freed here.
+    scrollback->start = (scrollback->start + scrollback->hot_number) % SCROLLBACK_HOT_MAX;
+    scrollback->hot_number = 0;
+
+    scrollback->segments_start = (scrollback->segments_start + scrollback->segments_number) % scrollback->segments_max;
+    scrollback->segments_number = 0;
+    scrollback->skipped = 0;
+
+    scrollback->lines_number = 0;
+    scrollback->bytes = 0;
+    scrollback->pending_length = 0;
+
+    // the file keeps the records, they are only skipped.
+    if (scrollback->file){
+        scrollback->file->first_line = scrollback->file->lines_number;
+        FILE_HEADER(scrollback->file)->first_line = scrollback->file->first_line;
+    }
+}
+
+void scrollback_mark_styles(TScrollback* scrollback, TStyleTable* styles){
+    TScrollbackLine* line;
+    int i, x;
+
+    for (i = 0; i < scrollback->hot_number; i++){
+        line = scrollback_hot_line(scrollback, i);
+        for (x = 0; x < line->length; x++){
+            style_mark(styles, line->cells[x].style);
+        }
+    }
+    for (x = 0; x < scrollback->pending_length; x++){
+        style_mark(styles, scrollback->pending[x].style);
+    }
+
+    // the packed lines hold the styles, which are interned
+    // again once they are unpacked.
+    for (i = 0; i < SCROLLBACK_CACHE_SEGMENTS; i++){
+        scrollback->cache[i].serial = -1;
+    }
+}
+
+void scrollback_mark_clusters(TScrollback* scrollback, TClusterTable* clusters){
+    TScrollbackLine* line;
+    int i, x;
+
+    for (i = 0; i < scrollback->hot_number; i++){
+        line = scrollback_hot_line(scrollback, i);
+        for (x = 0; x < line->length; x++){
+            if (line->cells[x].character_code & ELEMENT_CLUSTER){
+                cluster_mark(clusters, line->cells[x].character_code & ~ELEMENT_CLUSTER);
+            }
+        }
+    }
+    for (x = 0; x < scrollback->pending_length; x++){
+        if (scrollback->pending[x].character_code & ELEMENT_CLUSTER){
+            cluster_mark(clusters, scrollback->pending[x].character_code & ~ELEMENT_CLUSTER);
+        }
+    }
+
+    // the packed lines hold the codepoints, their clusters are
+    // interned again once they are unpacked.
+    for (i = 0; i < SCROLLBACK_CACHE_SEGMENTS; i++){
+        scrollback->cache[i].serial = -1;
+    }
+}
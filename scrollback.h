@@ -0,0 +1,267 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+/*
+ * The rows that scrolled off the top of the screen. A row is handed
+ * over by pointer when it leaves the screen and is shrunk to the cells
+ * it uses, nothing is copied. The oldest rows are dropped once either
+ * the lines limit or the bytes limit is reached.
+ *
+ * The rows joined by auto wrap are kept as a single line, which is cut
+ * in rows of the width of the window only when it is viewed (see
+ * scrollback_view_row()), so a resize does not touch the scrollback.
+ *
+ * Only the newest lines are kept as cells, older ones are packed
+ * SCROLLBACK_SEGMENT_LINES at a time into a segment of utf8 text and
+ * style runs which is compressed (see lz.h). Segments are unpacked
+ * back to cells on demand into a small lru cache. The text has every
+ * codepoint of a cluster and the runs have the styles in full, which
+ * are interned again when unpacked, so a segment holds no ids.
+ *
+ * The trigrams of the text of a segment are kept with it (see
+ * trigram.h), so a search only unpacks the segments which may have what
+ * it looks for (see scrollback_previous_candidate()).
+ *
+ * Optionally every line is also appended to a file (see
+ * scrollback_open_file()), which then holds the whole history: the
+ * lines dropped from memory are read back from it.
+ */
+
+#include <stddef.h>
+
+#include "element.h"
+#include "style.h"
+#include "cluster.h"
+#include "trigram.h"
+
+#define SCROLLBACK_DEFAULT_LINES    (10000)
+#define SCROLLBACK_DEFAULT_BYTES    (32 * 1024 * 1024)
+
+#define SCROLLBACK_HOT_LINES        (1024)  // never packed.
+#define SCROLLBACK_SEGMENT_LINES    (256)
+#define SCROLLBACK_CACHE_SEGMENTS   (4)
+#define SCROLLBACK_PENDING_MAX      (64 * 1024) // cells of a wrapped line.
+
+// slots of the ring of unpacked lines.
+#define SCROLLBACK_HOT_MAX          (SCROLLBACK_HOT_LINES + SCROLLBACK_SEGMENT_LINES)
+
+typedef struct{
+    TElement* cells;    // NULL for an empty row.
+    int length;         // the used width of the row.
+}TScrollbackLine;
+
+// the rows a line of length cells takes at a width, unless a wide
+// character would be split at the end of a row (see scrollback_view_row()).
+#define SCROLLBACK_VIEW_ROWS(length, width) ((length) > 0 ? ((length) + (width) - 1) / (width) : 1)
+
+typedef struct{
+    long long serial;   // never reused, identifies the segment in the cache.
+
+    char* data;         // compressed.
+    int size;
+    int raw_size;
+    int cells_number;
+
+    // the rows the lines take at view_width, 0 until viewed.
+    int view_width;
+    int view_rows;
+
+    TTrigramFilter trigrams;
+}TScrollbackSegment;
+
+typedef struct{
+    long long serial;   // of the unpacked segment, -1 if none.
+    unsigned long long used;
+
+    TScrollbackLine lines[SCROLLBACK_SEGMENT_LINES];
+    TElement* cells;
+    int cells_capacity;
+}TScrollbackCache;
+
+/*
+ * The file is mapped and only ever appended to: a header, then a record
+ * for every line, a 4 byte size followed by the line in the segment
+ * format with the styles written out in full, so the file does not
+ * depend on the ids of a running terminal. The header is updated after
+ * a record is complete, a record cut by a crash is ignored when the file
+ * is opened again.
+ */
+#define SCROLLBACK_FILE_MAGIC       (0x42535454) // "TTSB"
+#define SCROLLBACK_FILE_VERSION     (1)
+#define SCROLLBACK_FILE_GROW        (16 * 1024 * 1024)
+
+// the lines of the file whose rows are counted together when viewed.
+#define SCROLLBACK_FILE_BLOCK_LINES (1024)
+
+// the index of the lines is kept in a temporary file in the directory of
+// the file, made from this template (see mkstemp()).
+#define SCROLLBACK_INDEX_TEMPLATE   ".scrollback.XXXXXX"
+
+typedef struct{
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long size;            // of the header and the complete records.
+    unsigned long long lines_number;
+    unsigned long long first_line;      // the lines before were cleared.
+}TScrollbackFileHeader;
+
+typedef struct{
+    // the rows the lines take at view_width, 0 until viewed.
+    int view_width;
+    int view_rows;
+}TScrollbackFileBlock;
+
+typedef struct{
+    int fd;
+    char* map;
+    size_t map_size;
+
+    // offset of the record of every line, in a mapped file of its own
+    // which is unlinked once open and rebuilt on every open.
+    int index_fd;
+    unsigned long long* index;
+    size_t index_size;
+
+    int lines_number;
+    int first_line;
+
+    // every SCROLLBACK_FILE_BLOCK_LINES lines from the first one of the
+    // file, the lines never change once written.
+    TScrollbackFileBlock* blocks;
+    int blocks_number;
+
+    TStyleTable* styles;
+    TClusterTable* clusters;
+
+    // the last line read.
+    TScrollbackLine line;
+    int cells_capacity;
+}TScrollbackFile;
+
+typedef struct{
+    // ring of the segments, oldest first. the first skipped
+    // lines of the oldest segment were already dropped.
+    TScrollbackSegment** segments;
+    int segments_max;
+    int segments_start;
+    int segments_number;
+    int skipped;
+    long long next_serial;
+
+    // ring of the newest lines, which are not packed.
+    TScrollbackLine* lines;
+    int start;
+    int hot_number;
+
+    int lines_number; // packed and not.
+    int lines_max;
+
+    // bytes of the cells, of the pending line and of the segments.
+    size_t bytes;
+    size_t bytes_max;
+
+    TScrollbackCache cache[SCROLLBACK_CACHE_SEGMENTS];
+    unsigned long long clock;
+    long long unpacks_number;
+
+    // scratch space for packing and unpacking.
+    char* buffer;
+    int buffer_size;
+
+    TScrollbackFile* file; // NULL unless backed by a file.
+
+    TStyleTable* styles;        // of the cells.
+    TClusterTable* clusters;
+
+    // the rows of a line which goes on on the screen, it is pushed
+    // once its last row scrolls off, or cut once it has more than
+    // SCROLLBACK_PENDING_MAX cells. counted in bytes.
+    TElement* pending;
+    int pending_length;
+    int pending_capacity;
+
+    TScrollbackLine view; // the last row viewed.
+}TScrollback;
+
+
+// the styles and clusters of the cells pushed are looked up and interned
+// in styles and clusters.
+TScrollback* scrollback_create(int lines_max, size_t bytes_max, TStyleTable* styles, TClusterTable* clusters);
+void scrollback_destroy(TScrollback* scrollback);
+
+// drops the oldest lines that are over the new limits.
+int scrollback_set_limits(TScrollback* scrollback, int lines_max, size_t bytes_max);
+
+/*
+ * Appends every line from now on to the file at path, which is created
+ * if needed. The lines of an existing file are recovered and come
+ * before the new ones, the lines in memory are cleared. styles are
+ * where the styles of the lines read from the file are interned. Fails
+ * if another terminal has the file open.
+ */
+int scrollback_open_file(TScrollback* scrollback, char* path, TStyleTable* styles);
+
+// all the lines that can be read, from the file if there is one.
+static inline int scrollback_lines_number(TScrollback* scrollback){
+    if (scrollback->file){
+        return scrollback->file->lines_number - scrollback->file->first_line;
+    }
+    return scrollback->lines_number;
+}
+
+/*
+ * Takes ownership of the row (even on failure), length is its used
+ * width, an empty row may be NULL. A wrapped row is joined with the
+ * rows after it, up to SCROLLBACK_PENDING_MAX cells (or bytes_max).
+ */
+int scrollback_push(TScrollback* scrollback, TElement* cells, int length, int wrapped);
+
+/*
+ * Packs the lines kept as cells but the last ones of less than a
+ * segment, so their style ids are no longer used (see
+ * scrollback_mark_styles()).
+ */
+int scrollback_pack_lines(TScrollback* scrollback);
+
+/*
+ * Line 0 is the oldest one. A packed line is unpacked with the rest of
+ * its segment, a line only in the file is read in O(1) through the
+ * index. The line is valid until the next call.
+ */
+TScrollbackLine* scrollback_line(TScrollback* scrollback, int i);
+
+/*
+ * The newest line up to i which may have every trigram of the hashes
+ * (see trigram_hash()), -1 if there is none. Only the packed lines have
+ * their trigrams kept, the others always may.
+ */
+int scrollback_previous_candidate(TScrollback* scrollback, unsigned int* hashes, int hashes_number, int i);
+
+// hands the rows of the pending line over, NULL if there is none.
+TElement* scrollback_take_pending(TScrollback* scrollback, int* length);
+
+/*
+ * The history cut in rows of width cells, row 0 is the newest one, 
+ * right above the screen. A row which would end on the left half of a
+ * wide character ends a cell early, the character starts the next one.
+ * The rows of a segment, and of a block of the lines only in the file,
+ * are counted the first time it is viewed at a width. NULL past the
+ * oldest row, the row is valid until the next call.
+ */
+TScrollbackLine* scrollback_view_row(TScrollback* scrollback, int width, int row);
+
+// drops the oldest lines from memory, the file keeps them.
+void scrollback_drop(TScrollback* scrollback, int lines_number);
+
+// O(1), the rows and segments are freed when their slots are reused.
+void scrollback_clear(TScrollback* scrollback);
+
+// marks the style ids of the lines which are not packed, the unpacked
+// segments are dropped from the cache.
+void scrollback_mark_styles(TScrollback* scrollback, TStyleTable* styles);
+
+// marks the cluster ids of the lines which are not packed, the unpacked
+// segments are dropped from the cache.
+void scrollback_mark_clusters(TScrollback* scrollback, TClusterTable* clusters);
+
+#endif
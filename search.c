@@ -0,0 +1,451 @@
+#include "search.h"
+#include "common.h"
+#include "utf8.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+#define IS_LEAD_BYTE(c) (((unsigned char) (c) & 0xC0) != 0x80)
+
+/*
+ * The first and the last byte of the needle are compared at 16 positions
+ * at once, only the positions where both are equal are compared in full.
+ */
+static char* search_memmem(char* haystack, int len, char* needle, int needle_length){
+    int i = 0;
+
+    if (needle_length == 0){
+        return haystack;
+    }
+
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+
+    for (; i + needle_length - 1 + 16 <= len; i += 16){
+        __m128i a = _mm_loadu_si128((__m128i*) &haystack[i]);
+        __m128i b = _mm_loadu_si128((__m128i*) &haystack[i + needle_length - 1]);
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                            _mm_cmpeq_epi8(b, last)));
+
+        while (mask){
+            int offset = i + __builtin_ctz(mask);
+
+            if (needle_length <= 2 || memcmp(&haystack[offset + 1], &needle[1], needle_length - 2) == 0){
+                return &haystack[offset];
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i + needle_length <= len; i++){
+        if (haystack[i] == needle[0] && memcmp(&haystack[i], needle, needle_length) == 0){
+            return &haystack[i];
+        }
+    }
+    return NULL;
+}
+
+static void search_fold(char* text, int len){
+    int i;
+
+    for (i = 0; i < len; i++){
+        text[i] = trigram_fold(text[i]);
+    }
+}
+
+/*
+ * The longest run of the pattern which every match has: the characters
+ * out of groups which are not made optional by a quantifier. There is
+ * none if the pattern has an alternative.
+ */
+static int search_regex_literal(char* pattern, char* literal){
+    int length = strlen(pattern);
+    int literal_length = 0;
+    int run_length = 0;
+    int depth = 0;
+    char* run;
+    int i;
+
+    if (strchr(pattern, '|')){
+        return 0;
+    }
+
+    run = (char*) malloc(length + 1);
+    ASSERT(run, "failed to malloc regex literal.\n");
+
+#define END_RUN()   do{                                             \
+                        if (run_length > literal_length){           \
+                            memcpy(literal, run, run_length);       \
+                            literal_length = run_length;            \
+                        }                                           \
+                        run_length = 0;                             \
+                    }while (0)
+
+    for (i = 0; i < length; i++){
+        switch (pattern[i]){
+        case '(':
+            depth++;
+            END_RUN();
+            break;
+        case ')':
+            depth--;
+            END_RUN();
+            break;
+        case '[':
+            END_RUN();
+            i++;
+            if (pattern[i] == '^'){
+                i++;
+            }
+            if (pattern[i] == ']'){
+                i++;
+            }
+            while (i < length && pattern[i] != ']'){
+                i++;
+            }
+            break;
+        case '*':
+        case '?':
+        case '{':
+            // the character before may not be there.
+            if (run_length > 0){
+                run_length--;
+            }
+            END_RUN();
+            if (pattern[i] == '{'){
+                while (i < length && pattern[i] != '}'){
+                    i++;
+                }
+            }
+            break;
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+            END_RUN();
+            break;
+        case '\\':
+            i++;
+            if (i >= length || (pattern[i] >= '0' && pattern[i] <= '9') ||
+                (pattern[i] >= 'a' && pattern[i] <= 'z') || (pattern[i] >= 'A' && pattern[i] <= 'Z')){
+                END_RUN();
+                break;
+            }
+            // an escaped character is itself.
+            /* fall through */
+        default:
+            if (depth > 0){
+                END_RUN();
+                break;
+            }
+            run[run_length++] = pattern[i];
+            break;
+        }
+    }
+    END_RUN();
+
+#undef END_RUN
+
+    free(run);
+    return literal_length;
+
+fail:
+    return 0;
+}
+
+TSearch* search_create(Terminal* terminal, char* query, int flags){
+    TSearch* search;
+    int ret;
+    int i, j;
+
+    search = (TSearch*) calloc(1, sizeof(TSearch));
+    ASSERT(search, "failed to malloc search.\n");
+
+    search->terminal = terminal;
+    search->flags = flags;
+
+    search->literal = (char*) malloc(strlen(query) + 1);
+    ASSERT_TO(fail_on_literal, search->literal, "failed to malloc search literal.\n");
+
+    if (flags & SEARCH_REGEX){
+        ret = regcomp(&search->regex, query, REG_EXTENDED | ((flags & SEARCH_IGNORE_CASE) ? REG_ICASE : 0));
+        ASSERT_TO(fail_on_literal, (ret == 0), "failed to compile search regex.\n");
+
+        search->literal_length = search_regex_literal(query, search->literal);
+    }else{
+        search->literal_length = strlen(query);
+        memcpy(search->literal, query, search->literal_length);
+        ASSERT_TO(fail_on_literal, (search->literal_length > 0), "empty search.\n");
+    }
+    if (flags & SEARCH_IGNORE_CASE){
+        search_fold(search->literal, search->literal_length);
+    }
+
+    for (i = 0; i + 3 <= search->literal_length && search->hashes_number < SEARCH_HASHES_MAX; i++){
+        unsigned int hash = trigram_hash(&search->literal[i]);
+
+        for (j = 0; j < search->hashes_number && search->hashes[j] != hash; j++);
+        if (j == search->hashes_number){
+            search->hashes[search->hashes_number++] = hash;
+        }
+    }
+
+    search->next_line = scrollback_lines_number(terminal->scrollback) + terminal->rows_number - 1;
+    return search;
+
+fail_on_literal:
+    free(search->literal);
+    free(search);
+fail:
+    return NULL;
+}
+
+void search_destroy(TSearch* search){
+    ASSERT(search, "trying to destroy NULL search.\n");
+
+    if (search->flags & SEARCH_REGEX){
+        regfree(&search->regex);
+    }
+    free(search->literal);
+    free(search->matches);
+    free(search->text);
+    free(search->folded);
+    free(search->cells);
+    free(search);
+
+fail:
+    return;
+}
+
+// ------------------------------------------------------------
+
+// appends the cells to the text of the line, from cell *x on.
+static int search_encode(TSearch* search, int* len, int* x, TElement* cells, int length){
+    int bound = *len + (4 * length) + 1;
+    int i, size;
+
+    // 4 bytes for every cell but the clusters and the terminating 0.
+    for (i = 0; i < length; i++){
+        if (cells[i].character_code & ELEMENT_CLUSTER){
+            bound += CLUSTER_UTF8_MAX;
+        }
+    }
+    if (bound > search->text_capacity){
+        int capacity = bound;
+        char* text;
+        int* text_cells;
+
+        text = (char*) realloc(search->text, capacity);
+        ASSERT(text, "failed to realloc search text.\n");
+        search->text = text;
+
+        text = (char*) realloc(search->folded, capacity);
+        ASSERT(text, "failed to realloc search text.\n");
+        search->folded = text;
+
+        text_cells = (int*) realloc(search->cells, sizeof(int) * capacity);
+        ASSERT(text_cells, "failed to realloc search cells.\n");
+        search->cells = text_cells;
+
+        search->text_capacity = capacity;
+    }
+
+    // a spacer is part of the wide character before it, and a pad is
+    // not part of the line.
+    for (i = 0; i < length; i++, (*x)++){
+        if (cells[i].character_code == ELEMENT_SPACER || (cells[i].flags & ELEMENT_PAD)){
+            continue;
+        }
+
+        size = cluster_encode(search->terminal->clusters, cells[i].character_code, &search->text[*len]);
+        while (size-- > 0){
+            search->cells[(*len)++] = *x;
+        }
+    }
+    search->text[*len] = 0;
+    search->cells[*len] = *x;
+    return 0;
+
+fail:
+    return -1;
+}
+
+static int search_add_match(TSearch* search, int line, int x, int length){
+    if (search->matches_number == search->matches_capacity){
+        int capacity = search->matches_capacity ? search->matches_capacity * 2 : 64;
+        TSearchMatch* matches = (TSearchMatch*) realloc(search->matches, sizeof(TSearchMatch) * capacity);
+        ASSERT(matches, "failed to realloc search matches.\n");
+
+        search->matches = matches;
+        search->matches_capacity = capacity;
+    }
+
+    search->matches[search->matches_number].line = line;
+    search->matches[search->matches_number].x = x;
+    search->matches[search->matches_number].length = length;
+    search->matches_number++;
+    return 0;
+
+fail:
+    return -1;
+}
+
+// appends the matches in the text of the line, left to right.
+static int search_match_line(TSearch* search, int line, int len){
+    char* haystack = search->text;
+    int offset = 0;
+    int start, end;
+    int ret;
+
+    search->lines_read++;
+
+    if (search->flags & SEARCH_IGNORE_CASE){
+        memcpy(search->folded, search->text, len + 1);
+        search_fold(search->folded, len);
+        haystack = search->folded;
+    }
+
+    if (!(search->flags & SEARCH_REGEX)){
+        char* found;
+
+        while ((found = search_memmem(&haystack[offset], len - offset, search->literal, search->literal_length))){
+            start = found - haystack;
+            end = start + search->literal_length;
+
+            ret = search_add_match(search, line, search->cells[start], search->cells[end] - search->cells[start]);
+            ASSERT((ret == 0), "failed to add search match.\n");
+            offset = end;
+        }
+        return 0;
+    }
+
+    if (search->literal_length > 0 &&
+        !search_memmem(haystack, len, search->literal, search->literal_length)){
+        return 0;
+    }
+
+    while (offset <= len){
+        regmatch_t match;
+
+        if (regexec(&search->regex, &search->text[offset], 1, &match, offset > 0 ? REG_NOTBOL : 0) != 0){
+            break;
+        }
+        start = offset + match.rm_so;
+        end = offset + match.rm_eo;
+
+        if (end > start){
+            ret = search_add_match(search, line, search->cells[start], search->cells[end] - search->cells[start]);
+            ASSERT((ret == 0), "failed to add search match.\n");
+            offset = end;
+            continue;
+        }
+
+        // an empty match, the search goes on from the next character.
+        if (start >= len){
+            break;
+        }
+        offset = start + 1;
+        while (offset < len && !IS_LEAD_BYTE(search->text[offset])){
+            offset++;
+        }
+    }
+    return 0;
+
+fail:
+    return -1;
+}
+
+// the line of the screen which ends on row y, returns the row it starts on.
+static int search_screen_line(TSearch* search, int history, int y){
+    Terminal* terminal = search->terminal;
+    TScrollback* scrollback = terminal->scrollback;
+    TElement* row;
+    int first = y;
+    int len = 0;
+    int x = 0;
+    int length;
+    int ret;
+    int i;
+
+    while (first > 0 && (*terminal_line_flags(terminal, first - 1) & ROW_WRAPPED)){
+        first--;
+    }
+
+    // the line on row 0 goes on from the pending line of the scrollback,
+    // whose cells come first, before x 0.
+    if (first == 0 && scrollback->pending_length > 0){
+        x = -scrollback->pending_length;
+        ret = search_encode(search, &len, &x, scrollback->pending, scrollback->pending_length);
+        ASSERT((ret == 0), "failed to encode pending line.\n");
+    }
+
+    for (i = first; i <= y; i++){
+        row = terminal_line(terminal, i);
+        length = terminal->cols_number;
+
+        // the blanks at the end of the line, as in the scrollback.
+        if (i == y){
+            while (length > 0 && row[length - 1].character_code == ' '){
+                length--;
+            }
+        }
+
+        x = (i - first) * terminal->cols_number;
+        ret = search_encode(search, &len, &x, row, length);
+        ASSERT((ret == 0), "failed to encode screen line.\n");
+    }
+
+    ret = search_match_line(search, history + first, len);
+    ASSERT((ret == 0), "failed to search screen line.\n");
+    return first;
+
+fail:
+    return -1;
+}
+
+int search_step(TSearch* search, int lines_number){
+    TScrollback* scrollback = search->terminal->scrollback;
+    TScrollbackLine* line;
+    int history = scrollback_lines_number(scrollback);
+    int i = search->next_line;
+    int len, x;
+    int ret;
+
+    for (; lines_number > 0 && i >= 0; lines_number--){
+        if (i >= history){
+            ret = search_screen_line(search, history, i - history);
+            ASSERT((ret >= 0), "failed to search the screen.\n");
+
+            i = history + ret - 1;
+            continue;
+        }
+
+        i = scrollback_previous_candidate(scrollback, search->hashes, search->hashes_number, i);
+        if (i < 0){
+            break;
+        }
+
+        len = 0;
+        x = 0;
+        line = scrollback_line(scrollback, i);
+        ret = search_encode(search, &len, &x, line->cells, line->length);
+        ASSERT((ret == 0), "failed to encode scrollback line.\n");
+
+        ret = search_match_line(search, i, len);
+        ASSERT((ret == 0), "failed to search scrollback line.\n");
+        i--;
+    }
+
+    search->next_line = i;
+    return i >= 0;
+
+fail:
+    search->next_line = -1;
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <regex.h>
+
+#include "terminal.h"
+
+/*
+ * Search of the screen and of the whole scrollback, newest line first.
+ * Every search_step() reads a few more lines, so a ui can show the
+ * first matches while the rest of a long history is still read.
+ *
+ * The lines are read as utf8 and the text is looked for with memmem,
+ * which compares 16 bytes at a time with SSE2. The packed scrollback
+ * segments which can't have a query of 3 bytes or more are skipped by
+ * their trigrams (see trigram.h) without being unpacked. A regex is
+ * only matched on the lines which have its longest literal, if it has one.
+ *
+ * The lines are numbered as in the scrollback and the screen lines come
+ * after them: the line starting on row y of the screen is line
+ * scrollback_lines_number() + y. The line on row 0 is read with the
+ * rows of the pending line of the scrollback it goes on from, if any.
+ * The matches are valid until the terminal is pushed to again.
+ */
+
+#define SEARCH_REGEX            (1 << 0) // posix extended.
+#define SEARCH_IGNORE_CASE      (1 << 1) // ascii letters only, unless SEARCH_REGEX.
+
+#define SEARCH_HASHES_MAX       (16)
+
+typedef struct{
+    int line;
+    int x;          // in cells, past the first row for a line joined by auto wrap,
+                    // negative in the pending line of the scrollback.
+    int length;     // in cells.
+}TSearchMatch;
+
+typedef struct{
+    Terminal* terminal;
+    int flags;
+
+    // what every match has, folded with SEARCH_IGNORE_CASE.
+    char* literal;
+    int literal_length;
+    unsigned int hashes[SEARCH_HASHES_MAX];
+    int hashes_number;
+
+    regex_t regex;
+
+    int next_line;  // read from the newest, -1 once done.
+    long long lines_read;
+
+    TSearchMatch* matches;
+    int matches_number;
+    int matches_capacity;
+
+    // the line being read, its copy folded to lower case and the
+    // cell of every byte of the text.
+    char* text;
+    char* folded;
+    int* cells;
+    int text_capacity;
+}TSearch;
+
+
+TSearch* search_create(Terminal* terminal, char* query, int flags);
+void search_destroy(TSearch* search);
+
+/*
+ * Reads up to lines_number more lines and appends their matches,
+ * returns 1 while lines are left, 0 once done.
+ */
+int search_step(TSearch* search, int lines_number);
+
+#endif
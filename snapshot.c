@@ -0,0 +1,353 @@
+#include "snapshot.h"
+#include "common.h"
+#include "parser.h"
+
+#include <string.h>
+
+
+typedef struct{
+    char* buf;
+    int len;
+    int capacity;
+    int failed;
+}TSnapshotWriter;
+
+typedef struct{
+    char* buf;
+    int len;
+    int offset;
+    int failed;
+}TSnapshotReader;
+
+static void snapshot_write(TSnapshotWriter* writer, void* data, int len){
+    if (writer->failed){
+        return;
+    }
+
+    if (writer->len + len > writer->capacity){
+        int capacity = writer->capacity ? writer->capacity : 4096;
+        char* buf;
+
+        while (writer->len + len > capacity){
+            capacity *= 2;
+        }
+        buf = (char*) realloc(writer->buf, capacity);
+        if (!buf){
+            writer->failed = TRUE;
+            return;
+        }
+        writer->buf = buf;
+        writer->capacity = capacity;
+    }
+
+    memcpy(&writer->buf[writer->len], data, len);
+    writer->len += len;
+}
+
+static void snapshot_read(TSnapshotReader* reader, void* data, int len){
+    if (reader->failed || reader->offset + len > reader->len){
+        reader->failed = TRUE;
+        memset(data, 0, len);
+        return;
+    }
+
+    memcpy(data, &reader->buf[reader->offset], len);
+    reader->offset += len;
+}
+
+#define WRITE(x)    snapshot_write(&writer, &(x), sizeof(x))
+#define READ(x)     snapshot_read(&reader, &(x), sizeof(x))
+
+// the character of a cell, a cluster with the number of its codepoints
+// and all of them since cluster ids are local to the terminal.
+static void snapshot_write_character(TSnapshotWriter* writer, Terminal* terminal, TElement* element){
+    unsigned int* codes;
+    int length = terminal_codes(terminal, element, &codes);
+
+    snapshot_write(writer, &element->character_code, sizeof(element->character_code));
+    snapshot_write(writer, &element->flags, sizeof(element->flags));
+    if (element->character_code & ELEMENT_CLUSTER){
+        snapshot_write(writer, &length, sizeof(length));
+        snapshot_write(writer, codes, sizeof(unsigned int) * length);
+    }
+}
+
+static void snapshot_read_character(TSnapshotReader* reader, Terminal* terminal, TElement* element){
+    unsigned int codes[CLUSTER_CODES_MAX];
+    int length;
+    int id;
+
+    snapshot_read(reader, &element->character_code, sizeof(element->character_code));
+    snapshot_read(reader, &element->flags, sizeof(element->flags));
+    element->flags &= ELEMENT_PAD;
+    if (!(element->character_code & ELEMENT_CLUSTER)){
+        return;
+    }
+
+    snapshot_read(reader, &length, sizeof(length));
+    if (!BETWEEN(length, 1, CLUSTER_CODES_MAX)){
+        reader->failed = TRUE;
+        element->character_code = ' ';
+        return;
+    }
+    snapshot_read(reader, codes, sizeof(unsigned int) * length);
+
+    id = cluster_intern(terminal->clusters, codes, length);
+    if (id < 0 && cluster_table_grow(terminal->clusters) == 0){
+        id = cluster_intern(terminal->clusters, codes, length);
+    }
+    element->character_code = (id < 0) ? codes[0] : (ELEMENT_CLUSTER | id);
+}
+
+// the flags of row y of the screen which is not shown.
+static unsigned char* snapshot_other_flags(Terminal* terminal, int y){
+    return &terminal->other_lines_flags[(terminal->other_start_line_index + y) % terminal->rows_number];
+}
+
+int terminal_snapshot(Terminal* terminal, char** buf, int* len){
+    TSnapshotWriter writer = { 0 };
+    unsigned int magic = SNAPSHOT_MAGIC;
+    unsigned int version = SNAPSHOT_VERSION;
+    int x, y;
+
+    WRITE(magic);
+    WRITE(version);
+
+    WRITE(terminal->cols_number);
+    WRITE(terminal->rows_number);
+
+    WRITE(terminal->cursor);
+    WRITE(terminal->wrap_pending);
+    WRITE(terminal->saved_cursor);
+    WRITE(terminal->top);
+    WRITE(terminal->bottom);
+
+    WRITE(terminal->default_background_color);
+    WRITE(terminal->default_foreground_color);
+
+    // parser state.
+    WRITE(terminal->utf8_decoder);
+    WRITE(terminal->state);
+    WRITE(terminal->vt_mode);
+    WRITE(terminal->attributes);
+    WRITE(terminal->charset);
+    WRITE(terminal->background_color);
+    WRITE(terminal->foreground_color);
+    WRITE(terminal->intermediates);
+    WRITE(terminal->intermediates_index);
+    WRITE(terminal->private_marker);
+    WRITE(terminal->csi_parameters);
+    WRITE(terminal->csi_parameters_index);
+    WRITE(terminal->csi_subparameters);
+    WRITE(terminal->osc_buffer_index);
+    snapshot_write(&writer, terminal->osc_buffer, terminal->osc_buffer_index);
+
+    // grid, top to bottom, with the style of every cell written 
+    // out since style ids are local to the terminal.
+    for (y = 0; y < terminal->rows_number; y++){
+        WRITE(*terminal_line_flags(terminal, y));
+
+        for (x = 0; x < terminal->cols_number; x++){
+            TElement* element = terminal_element(terminal, x, y);
+            TStyle* style = terminal_style(terminal, element->style);
+
+            snapshot_write_character(&writer, terminal, element);
+            WRITE(style->attributes);
+            WRITE(style->foreground_color);
+            WRITE(style->background_color);
+        }
+    }
+
+    // the screen which is not shown, the same way.
+    WRITE(terminal->alternate);
+    for (y = 0; y < terminal->rows_number; y++){
+        TElement* line = terminal_other_line(terminal, y);
+
+        WRITE(*snapshot_other_flags(terminal, y));
+
+        for (x = 0; x < terminal->cols_number; x++){
+            TStyle* style = terminal_style(terminal, line[x].style);
+
+            snapshot_write_character(&writer, terminal, &line[x]);
+            WRITE(style->attributes);
+            WRITE(style->foreground_color);
+            WRITE(style->background_color);
+        }
+    }
+
+    ASSERT_TO(fail_on_write, !writer.failed, "failed to write snapshot.\n");
+
+    *buf = writer.buf;
+    *len = writer.len;
+    return 0;
+
+fail_on_write:
+    free(writer.buf);
+    return -1;
+}
+
+// the fields which index the screen, the parser tables or the buffers
+// of the terminal, out of range only in a corrupt snapshot.
+static int snapshot_check_state(Terminal* terminal){
+    ASSERT((BETWEEN(terminal->cursor.x, 0, terminal->cols_number - 1) &&
+            BETWEEN(terminal->cursor.y, 0, terminal->rows_number - 1)), "bad snapshot cursor.\n");
+    ASSERT((BETWEEN(terminal->saved_cursor.x, 0, terminal->cols_number - 1) &&
+            BETWEEN(terminal->saved_cursor.y, 0, terminal->rows_number - 1)), "bad snapshot saved cursor.\n");
+    ASSERT((BETWEEN(terminal->top, 0, terminal->bottom) &&
+            BETWEEN(terminal->bottom, terminal->top, terminal->rows_number - 1)), "bad snapshot scrolling region.\n");
+
+    ASSERT((terminal->utf8_decoder.state < UTF8_STATES_NUMBER), "bad snapshot utf8 state.\n");
+    ASSERT((terminal->state < STATES_NUMBER), "bad snapshot parser state.\n");
+    ASSERT(BETWEEN(terminal->intermediates_index, 0, ESC_MAX_INTERMEDIATES), "bad snapshot intermediates.\n");
+    ASSERT((terminal->private_marker == 0 || BETWEEN(terminal->private_marker, 0x3C, 0x3F)),
+           "bad snapshot private marker.\n");
+    ASSERT((terminal->csi_parameters_index >= -1), "bad snapshot csi parameters index.\n");
+    ASSERT(BETWEEN(terminal->osc_buffer_index, 0, OSC_MAX_CHARS), "bad osc buffer index.\n");
+
+    // the parameters past the last one are ignored, whatever their index.
+    if (terminal->csi_parameters_index > CSI_MAX_PARAMETERS){
+        terminal->csi_parameters_index = CSI_MAX_PARAMETERS;
+    }
+    return 0;
+
+fail:
+    return -1;
+}
+
+// what a new terminal starts with, instead of a state which was rejected.
+static void snapshot_reset_state(Terminal* terminal){
+    terminal->cursor.x = 0;
+    terminal->cursor.y = 0;
+    terminal->wrap_pending = FALSE;
+    terminal->saved_cursor = terminal->cursor;
+    terminal->top = 0;
+    terminal->bottom = terminal->rows_number - 1;
+
+    terminal->utf8_decoder.state = UTF8_ACCEPT;
+    terminal->state = STATE_GROUND;
+    terminal->intermediates_index = 0;
+    terminal->private_marker = 0;
+    terminal->csi_parameters_index = -1;
+    terminal->osc_buffer_index = 0;
+}
+
+int terminal_restore(Terminal* terminal, char* buf, int len){
+    TSnapshotReader reader = { .buf = buf, .len = len };
+    TStyle style;
+    unsigned int magic, version;
+    int cols_number, rows_number;
+    int x, y;
+    int ret;
+
+    READ(magic);
+    READ(version);
+    ASSERT((magic == SNAPSHOT_MAGIC), "not a terminal snapshot.\n");
+    ASSERT((version == SNAPSHOT_VERSION), "unsupported snapshot version.\n");
+
+    READ(cols_number);
+    READ(rows_number);
+    ASSERT((cols_number > 0 && rows_number > 0), "bad snapshot dimensions.\n");
+
+    if (cols_number != terminal->cols_number ||
+        rows_number != terminal->rows_number){
+        ret = terminal_resize(terminal, cols_number, rows_number);
+        ASSERT(ret == 0, "failed to resize terminal.\n");
+    }
+
+    READ(terminal->cursor);
+    READ(terminal->wrap_pending);
+    READ(terminal->saved_cursor);
+    READ(terminal->top);
+    READ(terminal->bottom);
+
+    READ(terminal->default_background_color);
+    READ(terminal->default_foreground_color);
+
+    READ(terminal->utf8_decoder);
+    READ(terminal->state);
+    READ(terminal->vt_mode);
+    READ(terminal->attributes);
+    READ(terminal->charset);
+    READ(terminal->background_color);
+    READ(terminal->foreground_color);
+    READ(terminal->intermediates);
+    READ(terminal->intermediates_index);
+    READ(terminal->private_marker);
+    READ(terminal->csi_parameters);
+    READ(terminal->csi_parameters_index);
+    READ(terminal->csi_subparameters);
+    READ(terminal->osc_buffer_index);
+
+    ret = snapshot_check_state(terminal);
+    ASSERT_TO(fail_on_state, (ret == 0), "bad snapshot state.\n");
+    snapshot_read(&reader, terminal->osc_buffer, terminal->osc_buffer_index);
+
+    // every cell is rewritten, so the styles and the clusters are
+    // interned from scratch. the scrollback is not part of a snapshot
+    // and its ids are gone.
+    scrollback_clear(terminal->scrollback);
+    cluster_table_reset(terminal->clusters);
+    style.attributes = 0;
+    style.foreground_color = terminal->default_foreground_color;
+    style.background_color = terminal->default_background_color;
+    style_table_reset(terminal->styles, &style);
+
+    for (y = 0; y < rows_number; y++){
+        TElement* line = terminal_line_write(terminal, y);
+
+        ASSERT(line, "failed to write line.\n");
+        READ(*terminal_line_flags(terminal, y));
+
+        for (x = 0; x < cols_number; x++){
+            TElement* element = &line[x];
+            int id;
+
+            snapshot_read_character(&reader, terminal, element);
+            READ(style.attributes);
+            READ(style.foreground_color);
+            READ(style.background_color);
+
+            id = style_intern(terminal->styles, &style);
+            if (id < 0 && style_table_grow(terminal->styles) == 0){
+                id = style_intern(terminal->styles, &style);
+            }
+            element->style = (id < 0) ? STYLE_DEFAULT : id;
+            terminal_mark_damage(terminal, x, y);
+        }
+    }
+
+    // which screen is shown only tells which one the cells above are.
+    READ(terminal->alternate);
+    for (y = 0; y < rows_number; y++){
+        TElement* line = terminal_other_line_write(terminal, y);
+
+        ASSERT(line, "failed to write line.\n");
+        READ(*snapshot_other_flags(terminal, y));
+
+        for (x = 0; x < cols_number; x++){
+            int id;
+
+            snapshot_read_character(&reader, terminal, &line[x]);
+            READ(style.attributes);
+            READ(style.foreground_color);
+            READ(style.background_color);
+
+            id = style_intern(terminal->styles, &style);
+            if (id < 0 && style_table_grow(terminal->styles) == 0){
+                id = style_intern(terminal->styles, &style);
+            }
+            line[x].style = (id < 0) ? STYLE_DEFAULT : id;
+        }
+    }
+
+    ASSERT(!reader.failed, "snapshot is truncated.\n");
+
+    terminal_update_style(terminal);
+
+    return 0;
+
+fail_on_state:
+    snapshot_reset_state(terminal);
+fail:
+    return -1;
+}
@@ -0,0 +1,22 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "terminal.h"
+
+/*
+ * Serialized terminal state: both screens together with the cursor, modes
+ * and parser state, so pushing after a restore continues exactly where
+ * the snapshotted terminal was (even in the middle of a sequence).
+ * Values are stored in host byte order.
+ */
+
+#define SNAPSHOT_MAGIC      (0x50414E53) // "SNAP"
+#define SNAPSHOT_VERSION    (5)
+
+// *buf is allocated and should be freed by the caller.
+int terminal_snapshot(Terminal* terminal, char** buf, int* len);
+
+// the terminal is resized to the snapshot dimensions if needed.
+int terminal_restore(Terminal* terminal, char* buf, int len);
+
+#endif
@@ -0,0 +1,188 @@
+#include "style.h"
+#include "common.h"
+
+#include <string.h>
+
+
+// id states
+#define STYLE_FREE      (0)
+#define STYLE_USED      (1)
+#define STYLE_MARKED    (2)
+
+static unsigned int style_hash(TStyle* style){
+    unsigned int hash = style->attributes * 0x9E3779B1U;
+
+    hash ^= style->foreground_color + 0x7F4A7C15U + (hash << 6) + (hash >> 2);
+    hash ^= style->background_color + 0x7F4A7C15U + (hash << 6) + (hash >> 2);
+    return hash ^ (hash >> 16);
+}
+
+static int style_equal(TStyle* a, TStyle* b){
+    return  (a->attributes == b->attributes) &&
+            (a->foreground_color == b->foreground_color) &&
+            (a->background_color == b->background_color);
+}
+
+static void style_index_insert(TStyleTable* table, int id){
+    unsigned int mask = table->buckets_number - 1;
+    unsigned int bucket = style_hash(&table->styles[id]) & mask;
+
+    while (table->buckets[bucket]){
+        bucket = (bucket + 1) & mask;
+    }
+    table->buckets[bucket] = id + 1;
+}
+
+static void style_index_rebuild(TStyleTable* table){
+    memset(table->buckets, 0, sizeof(unsigned int) * table->buckets_number);
+
+    for (int id = 0; id < table->next_id; id++){
+        if (table->marks[id] != STYLE_FREE){
+            style_index_insert(table, id);
+        }
+    }
+}
+
+static int style_table_allocate(TStyleTable* table, int capacity){
+    TStyle* styles;
+    unsigned char* marks;
+    unsigned short* free_ids;
+    unsigned int* buckets;
+
+    styles = (TStyle*) realloc(table->styles, sizeof(TStyle) * capacity);
+    ASSERT(styles, "failed to realloc styles.\n");
+    table->styles = styles;
+
+    marks = (unsigned char*) realloc(table->marks, capacity);
+    ASSERT(marks, "failed to realloc style marks.\n");
+    memset(&marks[table->capacity], STYLE_FREE, capacity - table->capacity);
+    table->marks = marks;
+
+    free_ids = (unsigned short*) realloc(table->free_ids, sizeof(unsigned short) * capacity);
+    ASSERT(free_ids, "failed to realloc free style ids.\n");
+    table->free_ids = free_ids;
+
+    // kept at most half full.
+    buckets = (unsigned int*) realloc(table->buckets, sizeof(unsigned int) * capacity * 2);
+    ASSERT(buckets, "failed to realloc style buckets.\n");
+    table->buckets = buckets;
+    table->buckets_number = capacity * 2;
+
+    table->capacity = capacity;
+    return 0;
+
+fail:
+    return -1;
+}
+
+TStyleTable* style_table_create(TStyle* default_style){
+    TStyleTable* table = NULL;
+    int ret;
+
+    table = (TStyleTable*) malloc(sizeof(TStyleTable));
+    ASSERT(table, "failed to malloc() style table.\n");
+    memset(table, 0, sizeof(TStyleTable));
+
+    ret = style_table_allocate(table, STYLES_INITIAL_CAPACITY);
+    ASSERT_TO(fail_on_allocate, (ret == 0), "failed to allocate style table.\n");
+
+    style_table_reset(table, default_style);
+    return table;
+
+fail_on_allocate:
+    style_table_destroy(table);
+fail:
+    return NULL;
+}
+
+void style_table_destroy(TStyleTable* table){
+    ASSERT(table, "trying to destroy NULL style table.\n");
+
+    free(table->styles);
+    free(table->marks);
+    free(table->free_ids);
+    free(table->buckets);
+    free(table);
+
+fail:
+    return;
+}
+
+int style_table_reset(TStyleTable* table, TStyle* default_style){
+    memset(table->marks, STYLE_FREE, table->capacity);
+
+    table->styles[STYLE_DEFAULT] = *default_style;
+    table->marks[STYLE_DEFAULT] = STYLE_USED;
+    table->styles_number = 1;
+    table->next_id = STYLE_DEFAULT + 1;
+    table->free_ids_number = 0;
+
+    style_index_rebuild(table);
+    return 0;
+}
+
+int style_table_grow(TStyleTable* table){
+    int ret;
+
+    ASSERT((table->capacity < STYLES_MAX), "style table is at its maximum size.\n");
+
+    ret = style_table_allocate(table, table->capacity * 2);
+    ASSERT((ret == 0), "failed to grow style table.\n");
+
+    style_index_rebuild(table);
+    return 0;
+
+fail:
+    return -1;
+}
+
+int style_intern(TStyleTable* table, TStyle* style){
+    unsigned int mask = table->buckets_number - 1;
+    unsigned int bucket = style_hash(style) & mask;
+    int id;
+
+    while (table->buckets[bucket]){
+        id = table->buckets[bucket] - 1;
+        if (style_equal(&table->styles[id], style)){
+            return id;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+
+    if (table->free_ids_number > 0){
+        id = table->free_ids[--table->free_ids_number];
+    }else if (table->next_id < table->capacity){
+        id = table->next_id++;
+    }else{
+        return -1;
+    }
+
+    table->styles[id] = *style;
+    table->marks[id] = STYLE_USED;
+    table->styles_number++;
+
+    // the empty bucket the lookup stopped at.
+    table->buckets[bucket] = id + 1;
+    return id;
+}
+
+void style_mark(TStyleTable* table, unsigned short id){
+    if (table->marks[id] != STYLE_FREE){
+        table->marks[id] = STYLE_MARKED;
+    }
+}
+
+void style_sweep(TStyleTable* table){
+    for (int id = STYLE_DEFAULT + 1; id < table->next_id; id++){
+        if (table->marks[id] == STYLE_USED){
+            table->marks[id] = STYLE_FREE;
+            table->free_ids[table->free_ids_number++] = id;
+            table->styles_number--;
+        }else if (table->marks[id] == STYLE_MARKED){
+            table->marks[id] = STYLE_USED;
+        }
+    }
+    table->marks[STYLE_DEFAULT] = STYLE_USED;
+
+    style_index_rebuild(table);
+}
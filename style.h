@@ -0,0 +1,55 @@
+#ifndef STYLE_H
+#define STYLE_H
+
+/*
+ * Interned cell styles, every distinct attributes/colors triple is
+ * stored once and cells refer to it by a 16 bit id. Ids are not
+ * reference counted, the owner of the table marks the ids it still
+ * uses and sweeps the rest once the table fills up.
+ */
+
+#define STYLE_DEFAULT           (0) // always the default style.
+#define STYLES_MAX              (0x10000)
+#define STYLES_INITIAL_CAPACITY (1024)
+
+typedef struct{
+    unsigned int attributes;
+    unsigned int foreground_color;
+    unsigned int background_color;
+}TStyle;
+
+typedef struct{
+    TStyle* styles;         // by id.
+    unsigned char* marks;   // state of every id: free, used or marked.
+    int capacity;
+    int styles_number;
+
+    // ids that were swept, and the first id never given.
+    unsigned short* free_ids;
+    int free_ids_number;
+    int next_id;
+
+    // open addressing index from a style to its id + 1 (0 is empty).
+    unsigned int* buckets;
+    int buckets_number;
+}TStyleTable;
+
+
+TStyleTable* style_table_create(TStyle* default_style);
+void style_table_destroy(TStyleTable* table);
+
+// drops every style but the default one, which is replaced.
+int style_table_reset(TStyleTable* table, TStyle* default_style);
+
+// doubles the capacity, fails at STYLES_MAX.
+int style_table_grow(TStyleTable* table);
+
+// the id of the style, -1 if the table is full.
+int style_intern(TStyleTable* table, TStyle* style);
+
+void style_mark(TStyleTable* table, unsigned short id);
+
+// frees every id that was not marked since the last sweep.
+void style_sweep(TStyleTable* table);
+
+#endif
@@ -1,16 +1,27 @@
 #include "terminal.h"
 #include "common.h"
+#include "parser.h"
 #include "utf8.h"
 #include "color.h"
+#include "unicode.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 
 #define BLANK_ELEMENT (' ')
 
-#define ELEMENT (terminal->screen[(terminal->cursor.y * terminal->cols_number) + terminal->cursor.x])
+
+// index of row y in terminal->lines.
+#define LINE_INDEX(y) ((terminal->start_line_index + (y)) % terminal->rows_number)
+
+#define DAMAGE_WORD_BITS        (sizeof(unsigned int) * 8)
+#define DAMAGE_WORDS(rows)      (((rows) + DAMAGE_WORD_BITS - 1) / DAMAGE_WORD_BITS)
 
 // VT100 modes
 #define VT_LMN_MODE          (1 << 0) // New line mode
@@ -24,29 +35,21 @@
 #define VT_DECARM_MODE       (1 << 8) // Auto-repeate mode
 #define VT_DECINLM_MODE      (1 << 9) // Interlacing mode
 #define VT_DECKPAM_MODE      (1 << 10) // alternative/numeric keypad mode
+#define VT_SYNC_MODE         (1 << 11) // Synchronized output (2026)
 
 // mode operations
 #define IS_VT_MODE(x)        (terminal->vt_mode & x)
 #define SET_VT_MODE(x)       (terminal->vt_mode |= x)
 #define SET_NO_VT_MODE(x)    (terminal->vt_mode &= (~x))
 
-// terminal state machine modes definitions
-#define ESC_MODE             (1 << 0)
-#define ESC_G0_MODE          (1 << 1) // define G0 charset.
-#define ESC_G1_MODE          (1 << 2) // define G1 charset.
-#define ESC_CHARSET_MODE     (1 << 3) // define charset.
-#define CSI_MODE             (1 << 4)
-#define OSC_MODE             (1 << 5)
-// this mode is currently used by csi_get_parameters() to let us know 
-// the '?' character was prefixed the parameters what indicates use we 
-// in private mode.
-#define PRIVATE_MODE         (1 << 6)
-#define CSI_SPACE_MODE       (1 << 7)
+// csi parameters operations
+#define IS_SUBPARAMETER(i)       (terminal->csi_subparameters & (1u << (i)))
 
-// mode operations
-#define IS_MODE(x)       (terminal->mode & x)
-#define SET_MODE(x)      (terminal->mode |= x)
-#define SET_NO_MODE(x)   (terminal->mode &= (~x))
+// sequence collected characters operations
+// a '?' prefix of the csi parameters means dec private sequence.
+#define IS_PRIVATE()             (terminal->private_marker == '?')
+#define IS_INTERMEDIATE(x)       ((terminal->intermediates_index > 0) &&  \
+                                  (terminal->intermediates[0] == x))
 
 // attributes operations (the attributes defined in the header file)
 #define RESET_ATTR()     (terminal->attributes &= 0)
@@ -71,51 +74,276 @@
 
 // ------------------------------------------------------------
 // debug escaped handlers macros.
+// traced only while log_trace_enabled is set (see log.h).
 // ------------------------------------------------------------
 
-#define ESC_DEBUG
-#define CSI_DEBUG
-#define SGR_DEBUG
-
-// #undef ESC_DEBUG
-// #undef CSI_DEBUG
-// #undef SGR_DEBUG
-
-#ifdef ESC_DEBUG
 #define DEBUG_ESC_HANDLER(handler) do {                                 \
-    LOG("DEBUG_ESC: handler: %s.\n", handler);                          \
-}while(0)
-#else
-#define DEBUG_ESC_HANDLER(handler) do{                                  \
+    LOG_TRACE("DEBUG_ESC: handler: %s.\n", handler);                    \
 }while(0)
-#endif
 
-#ifdef CSI_DEBUG
 #define DEBUG_CSI_HANDLER(handler) do {                                 \
-    LOG("DEBUG_CSI: handler: %s.\n", handler);                          \
-    LOG("DEBUG_CSI: parameters:\"%s\".\n", terminal->csi_parameters);   \
-}while(0)
-#else
-#define DEBUG_CSI_HANDLER(handler) do{                                  \
+    if (!LOG_TRACING()) break;                                          \
+    LOG_TRACE("DEBUG_CSI: handler: %s.\n", handler);                    \
+    for (int i = 0; i <= terminal->csi_parameters_index &&              \
+                    i < CSI_MAX_PARAMETERS; i++){                       \
+        LOG_TRACE("DEBUG_CSI: parameter[%d]: %d\n",                     \
+                  i,                                                    \
+                  terminal->csi_parameters[i]);                         \
+    }                                                                   \
 }while(0)
-#endif
 
-#ifdef SGR_DEBUG
 #define DEBUG_SGR_HANDLER(handler) do {                                 \
-    LOG("DEBUG_SGR: handler: %s.\n", handler);                          \
-    LOG("DEBUG_SGR: parameters:\n");                                    \
+    if (!LOG_TRACING()) break;                                          \
+    LOG_TRACE("DEBUG_SGR: handler: %s.\n", handler);                    \
+    LOG_TRACE("DEBUG_SGR: parameters:\n");                              \
     for (int i = 0; i < left; i++){                                     \
-        LOG("\t parameter[%d]: %d\n", i, parameters[i]);                \
+        LOG_TRACE("\t parameter[%d]: %d\n", i, parameters[i]);          \
     }                                                                   \
 }while(0)
+
+// ------------------------------------------------------------
+
+static inline void terminal_damage_cells(Terminal* terminal, int y, int left, int right){
+    TDamage* damage = &terminal->damage[y];
+
+    terminal->damage_rows[y / DAMAGE_WORD_BITS] |= (1U << (y % DAMAGE_WORD_BITS));
+
+    if (left < damage->left){
+        damage->left = left;
+    }
+    if (right > damage->right){
+        damage->right = right;
+    }
+}
+
+static void terminal_damage_line(Terminal* terminal, int y){
+    terminal_damage_cells(terminal, y, 0, terminal->cols_number - 1);
+}
+
+static const TElement blank_element = { BLANK_ELEMENT, STYLE_DEFAULT, 0 };
+
+// cells [left, right] of line become element, 2 cells a store.
+static inline void terminal_fill_cells(TElement* line, int left, int right, TElement element){
+    int x = left;
+
+#ifdef __SSE2__
+    long long value;
+    __m128i cells;
+
+    memcpy(&value, &element, sizeof(value));
+    cells = _mm_set1_epi64x(value);
+    for (; x < right; x += 2){
+        _mm_storeu_si128((__m128i*) &line[x], cells);
+    }
+#endif
+    for (; x <= right; x++){
+        line[x] = element;
+    }
+}
+
+/*
+ * The first and last of cells [left, right] of line which are not
+ * element, compared 2 cells at a time. FALSE if they all are.
+ */
+static inline int terminal_diff_cells(TElement* line, int left, int right, TElement element, int* first, int* last){
+    int x = left;
+
+    *first = -1;
+    *last = -1;
+
+#ifdef __SSE2__
+    long long value;
+    __m128i cells;
+
+    memcpy(&value, &element, sizeof(value));
+    cells = _mm_set1_epi64x(value);
+    for (; x < right; x += 2){
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i*) &line[x]), cells));
+
+        if (mask != 0xFFFF){
+            if (*first < 0){
+                *first = (mask & 0xFF) != 0xFF ? x : x + 1;
+            }
+            *last = (mask >> 8) != 0xFF ? x + 1 : x;
+        }
+    }
+#endif
+    for (; x <= right; x++){
+        if (line[x].character_code != element.character_code ||
+            line[x].style != element.style ||
+            line[x].flags != element.flags){
+            if (*first < 0){
+                *first = x;
+            }
+            *last = x;
+        }
+    }
+    return *first >= 0;
+}
+
+// whether the 4 cells at line hold the 4 codes of a single cell each,
+// with the style.
+static inline int terminal_same_cells(TElement* line, unsigned int* codes, unsigned short style){
+#ifdef __SSE2__
+    __m128 a = _mm_castsi128_ps(_mm_loadu_si128((__m128i*) &line[0]));
+    __m128 b = _mm_castsi128_ps(_mm_loadu_si128((__m128i*) &line[2]));
+    __m128i chunk = _mm_loadu_si128((__m128i*) codes);
+
+    // the codes and the styles (with the flags above them) of the cells.
+    __m128i cell_codes = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i cell_styles = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+    __m128i same = _mm_and_si128(_mm_cmpeq_epi32(cell_codes, chunk),
+                                 _mm_cmpeq_epi32(cell_styles, _mm_set1_epi32(style)));
+
+    // everything below the first combining mark takes a single cell.
+    same = _mm_and_si128(same, _mm_cmplt_epi32(chunk, _mm_set1_epi32(0x300)));
+    return _mm_movemask_epi8(same) == 0xFFFF;
 #else
-#define DEBUG_SGR_HANDLER(handler) do{                                  \
-}while(0)
+    for (int i = 0; i < 4; i++){
+        if (codes[i] >= 0x300 || line[i].character_code != codes[i] || 
+            line[i].style != style || line[i].flags != 0){
+            return FALSE;
+        }
+    }
+    return TRUE;
 #endif
+}
 
-// ------------------------------------------------------------
+static void terminal_free_rows(Terminal* terminal, TElement** lines){
+    if (lines == NULL){
+        return;
+    }
+
+    for (int y = 0; y < terminal->rows_number; y++){
+        if (lines[y] != terminal->blank_line){
+            free(lines[y]);
+        }
+    }
+    free(lines);
+}
+
+// every row is allocated by itself so rows can be moved around by
+// pointer, once it is first written (see terminal_line_write()).
+static TElement** terminal_allocate_rows(Terminal* terminal, unsigned int** generations){
+    TElement** lines;
+
+    lines = (TElement**) malloc(sizeof(TElement*) * terminal->rows_number);
+    ASSERT(lines, "failed to malloc lines.\n");
+
+    *generations = (unsigned int*) calloc(terminal->rows_number, sizeof(unsigned int));
+    ASSERT_TO(fail_on_generations, *generations, "failed to malloc lines generations.\n");
+
+    for (int y = 0; y < terminal->rows_number; y++){
+        lines[y] = terminal->blank_line;
+    }
+    return lines;
+
+fail_on_generations:
+    free(lines);
+fail:
+    return NULL;
+}
+
+static void terminal_destroy_lines(Terminal* terminal){
+    if (terminal->blank_line == NULL){
+        return;
+    }
+
+    terminal_free_rows(terminal, terminal->lines);
+    terminal->lines = NULL;
+    free(terminal->lines_flags);
+    terminal->lines_flags = NULL;
+    free(terminal->lines_generation);
+    terminal->lines_generation = NULL;
+
+    terminal_free_rows(terminal, terminal->other_lines);
+    terminal->other_lines = NULL;
+    free(terminal->other_lines_flags);
+    terminal->other_lines_flags = NULL;
+    free(terminal->other_lines_generation);
+    terminal->other_lines_generation = NULL;
+
+    free(terminal->blank_line);
+    terminal->blank_line = NULL;
+
+    free(terminal->damage_rows);
+    terminal->damage_rows = NULL;
+    free(terminal->damage);
+    terminal->damage = NULL;
+}
+
+// both screens, blank.
+static int terminal_create_lines(Terminal* terminal){
+    terminal->blank_line = (TElement*) malloc(sizeof(TElement) * terminal->cols_number);
+    ASSERT(terminal->blank_line, "failed to malloc blank line.\n");
+    terminal_fill_cells(terminal->blank_line, 0, terminal->cols_number - 1, blank_element);
+
+    terminal->lines = terminal_allocate_rows(terminal, &terminal->lines_generation);
+    ASSERT_TO(fail_on_line, terminal->lines, "failed to allocate lines.\n");
+
+    terminal->lines_flags = (unsigned char*) calloc(terminal->rows_number, sizeof(unsigned char));
+    ASSERT_TO(fail_on_line, terminal->lines_flags, "failed to malloc lines flags.\n");
+
+    terminal->other_lines = terminal_allocate_rows(terminal, &terminal->other_lines_generation);
+    ASSERT_TO(fail_on_line, terminal->other_lines, "failed to allocate other lines.\n");
+
+    terminal->other_lines_flags = (unsigned char*) calloc(terminal->rows_number, sizeof(unsigned char));
+    ASSERT_TO(fail_on_line, terminal->other_lines_flags, "failed to malloc other lines flags.\n");
+
+    terminal->damage_rows = (unsigned int*) calloc(DAMAGE_WORDS(terminal->rows_number), 
+                                                   sizeof(unsigned int));
+    ASSERT_TO(fail_on_line, terminal->damage_rows, "failed to malloc damage rows.\n");
+
+    terminal->damage = (TDamage*) malloc(sizeof(TDamage) * terminal->rows_number);
+    ASSERT_TO(fail_on_line, terminal->damage, "failed to malloc damage.\n");
+
+    for (int y = 0; y < terminal->rows_number; y++){
+        terminal_clear_damage(terminal, y);
+    }
+
+    terminal->generation = 0;
+    terminal->other_generation = 0;
+    terminal->start_line_index = 0;
+    terminal->other_start_line_index = 0;
+    return 0;
+
+fail_on_line:
+    terminal_destroy_lines(terminal);
+fail:
+    return -1;
+}
+
+/*
+ * Shows the other screen, only the row pointers are swapped. Every row
+ * is damaged since none of them is what was drawn.
+ */
+static void terminal_swap_screens(Terminal* terminal){
+    TElement** lines = terminal->lines;
+    unsigned char* lines_flags = terminal->lines_flags;
+    unsigned int* lines_generation = terminal->lines_generation;
+    unsigned int generation = terminal->generation;
+    int start_line_index = terminal->start_line_index;
+
+    terminal->lines = terminal->other_lines;
+    terminal->lines_flags = terminal->other_lines_flags;
+    terminal->lines_generation = terminal->other_lines_generation;
+    terminal->generation = terminal->other_generation;
+    terminal->start_line_index = terminal->other_start_line_index;
+
+    terminal->other_lines = lines;
+    terminal->other_lines_flags = lines_flags;
+    terminal->other_lines_generation = lines_generation;
+    terminal->other_generation = generation;
+    terminal->other_start_line_index = start_line_index;
 
+    terminal->alternate = !terminal->alternate;
+    terminal->wrap_pending = FALSE;
 
+    for (int y = 0; y < terminal->rows_number; y++){
+        terminal_damage_line(terminal, y);
+    }
+}
 
 Terminal* terminal_create(  TPty* pty,
                             int cols_number, 
@@ -139,6 +367,8 @@ Terminal* terminal_create(  TPty* pty,
 
     terminal->start_line_index = 0;
 
+    terminal->state = STATE_GROUND;
+
     // start position.
     terminal->cursor.x = 0;
     terminal->cursor.y = 0;
@@ -153,7 +383,7 @@ Terminal* terminal_create(  TPty* pty,
 
     terminal->osc_buffer_index = 0;
 
-    terminal->csi_parameters_index = 0;
+    terminal->csi_parameters_index = -1;
     terminal->attributes = 0;
 
     // auto wrap mode is on by default.
@@ -162,13 +392,35 @@ Terminal* terminal_create(  TPty* pty,
     // default to g0 us charset
     SET_CHARSET(CHARSET_G0_US);
 
-    terminal->screen = (TElement*) malloc(sizeof(TElement) * cols_number * rows_number);
-    ASSERT_TO(fail_on_screen, terminal->screen, "failed to malloc screen.\n");
+    TStyle default_style = {
+        .attributes = 0,
+        .foreground_color = terminal->default_foreground_color,
+        .background_color = terminal->default_background_color
+    };
+    terminal->styles = style_table_create(&default_style);
+    ASSERT_TO(fail_on_screen, terminal->styles, "failed to create style table.\n");
+    terminal->style = STYLE_DEFAULT;
+
+    terminal->clusters = cluster_table_create();
+    ASSERT_TO(fail_on_clusters, terminal->clusters, "failed to create cluster table.\n");
+
+    terminal->scrollback = scrollback_create(SCROLLBACK_DEFAULT_LINES, SCROLLBACK_DEFAULT_BYTES, 
+                                             terminal->styles, terminal->clusters);
+    ASSERT_TO(fail_on_scrollback, terminal->scrollback, "failed to create scrollback.\n");
+
+    ret = terminal_create_lines(terminal);
+    ASSERT_TO(fail_on_lines, (ret == 0), "failed to create screen lines.\n");
 
     terminal_empty(terminal);
 
     return terminal;
 
+fail_on_lines:
+    scrollback_destroy(terminal->scrollback);
+fail_on_scrollback:
+    cluster_table_destroy(terminal->clusters);
+fail_on_clusters:
+    style_table_destroy(terminal->styles);
 fail_on_screen:
     free(terminal);
 fail:
@@ -177,95 +429,465 @@ fail:
 
 void terminal_destroy(Terminal* terminal){
     ASSERT(terminal, "trying to destroy NULL terminal.\n");
-    ASSERT(terminal->screen, "trying to destroy NULL terminal->screen.\n");
+    ASSERT(terminal->lines, "trying to destroy NULL terminal->lines.\n");
     
-    free(terminal->screen);
+    terminal_destroy_lines(terminal);
+    scrollback_destroy(terminal->scrollback);
+    cluster_table_destroy(terminal->clusters);
+    style_table_destroy(terminal->styles);
     free(terminal);
 
 fail:
     return;
 }
 
+// the number of cells up to the last one which is not blank.
+static int terminal_line_length(Terminal* terminal, TElement* line){
+    int length = terminal->cols_number;
+
+    while (length > 0 &&
+           line[length - 1].character_code == BLANK_ELEMENT &&
+           line[length - 1].style == STYLE_DEFAULT){
+        length--;
+    }
+    return length;
+}
+
+// the cells of a wrapped row which are part of its line, all but the
+// pad a wide character may have left at its end.
+static int terminal_wrapped_length(Terminal* terminal, TElement* line){
+    int length = terminal->cols_number;
+
+    return (line[length - 1].flags & ELEMENT_PAD) ? length - 1 : length;
+}
+
 /*
- * current implementation is reseting 
- * the terminal completely for now.. 
- * TODO:
+ * The cells of the row of a line which starts at offset, cut at
+ * cols_number: one less when the last one would be the left half of a
+ * wide character, which then goes on the next row and leaves the row
+ * padded, as terminal_put_char() does. The line has stored cells, its
+ * length may be past them.
  */
+static int terminal_reflow_count(TElement* line, int stored, int length, int offset, int cols_number){
+    int count = length - offset < cols_number ? length - offset : cols_number;
+
+    if (count == cols_number && cols_number > 1 && offset + count < stored &&
+        line[offset + count].character_code == ELEMENT_SPACER){
+        count--;
+    }
+    return count;
+}
 
+/*
+ * The rows joined by auto wrap are one line, which is cut again at the
+ * new width. The rows up to the cursor or the last one which is not
+ * blank are kept, the ones which no longer fit go to the scrollback 
+ * and the cursor stays on the same cell of its line. The rows of the
+ * top line which already are in the scrollback come back for it.
+ */
 int terminal_resize(Terminal* terminal, int cols_number, int rows_number){
-    ASSERT(terminal->screen, "trying to resize without any screen.\n");
+    TElement* cells = NULL;     // the lines of the screen, one after another.
+    TElement* pending;
+    int* starts = NULL;         // of every line in cells.
+    int* lengths = NULL;        // of every line, the cursor may be past its cells.
+    int lines_number = 0;
+    int cursor_line = 0;
+    int cursor_offset = 0;
+    int size = 0;
+    int rows, skip, cursor_row, cursor_x;
+    int last_y;
+    int ret;
+    int i, y;
+
+    ASSERT(terminal->lines, "trying to resize without any screen.\n");
+
+    if (cols_number == terminal->cols_number && rows_number == terminal->rows_number){
+        return 0;
+    }
+
+    // only the primary screen is rewrapped, around its saved cursor,
+    // the alternate one comes back blank for the application to redraw.
+    if (terminal->alternate){
+        TCursor cursor = terminal->cursor;
+
+        terminal_swap_screens(terminal);
+        terminal->cursor = terminal->saved_cursor;
+        terminal->saved_cursor = cursor;
+
+        ret = terminal_resize(terminal, cols_number, rows_number);
+        if (ret == 0){
+            terminal_swap_screens(terminal);
+        }
+
+        cursor = terminal->cursor;
+        terminal->cursor = terminal->saved_cursor;
+        terminal->saved_cursor = cursor;
+        if (terminal->cursor.x >= cols_number){
+            terminal->cursor.x = cols_number - 1;
+        }
+        if (terminal->cursor.y >= rows_number){
+            terminal->cursor.y = rows_number - 1;
+        }
+        return ret;
+    }
 
-    free(terminal->screen);
-    terminal->screen = NULL;
+    last_y = terminal->cursor.y;
+    for (y = terminal->rows_number - 1; y > last_y; y--){
+        if (terminal_line_length(terminal, terminal_line(terminal, y)) > 0 ||
+            (*terminal_line_flags(terminal, y) & ROW_WRAPPED)){
+            break;
+        }
+    }
+    last_y = y;
+
+    cells = (TElement*) malloc(sizeof(TElement) * (terminal->cols_number * (last_y + 1) +
+                                                   terminal->scrollback->pending_length));
+    starts = (int*) malloc(sizeof(int) * (last_y + 1));
+    lengths = (int*) malloc(sizeof(int) * (last_y + 1));
+    ASSERT_TO(fail_on_lines, (cells && starts && lengths), "failed to malloc resize lines.\n");
+
+    pending = scrollback_take_pending(terminal->scrollback, &size);
+    if (pending){
+        memcpy(cells, pending, sizeof(TElement) * size);
+        free(pending);
+
+        starts[0] = 0;
+        lengths[0] = size;
+        lines_number = 1;
+    }
+
+    for (y = 0; y <= last_y; y++){
+        TElement* line = terminal_line(terminal, y);
+        int wrapped = *terminal_line_flags(terminal, y) & ROW_WRAPPED;
+        int length = wrapped ? terminal_wrapped_length(terminal, line) : terminal_line_length(terminal, line);
+
+        if (lines_number == 0 || !(y == 0 || (*terminal_line_flags(terminal, y - 1) & ROW_WRAPPED))){
+            starts[lines_number] = size;
+            lengths[lines_number] = 0;
+            lines_number++;
+        }
+
+        memcpy(&cells[size], line, sizeof(TElement) * length);
+        size += length;
+        lengths[lines_number - 1] = size - starts[lines_number - 1];
+
+        if (y == terminal->cursor.y){
+            // a pending wrap puts the cursor right after the last column.
+            cursor_line = lines_number - 1;
+            cursor_offset = size - length - starts[cursor_line] + 
+                            terminal->cursor.x + (terminal->wrap_pending ? 1 : 0);
+        }
+    }
+    if (lengths[cursor_line] < cursor_offset + 1){
+        lengths[cursor_line] = cursor_offset + 1;
+    }
+
+    // an empty line still takes a row.
+    for (i = 0; i < lines_number; i++){
+        if (lengths[i] == 0){
+            lengths[i] = 1;
+        }
+    }
+
+    rows = 0;
+    cursor_row = 0;
+    cursor_x = 0;
+    for (i = 0; i < lines_number; i++){
+        int stored = (i + 1 < lines_number ? starts[i + 1] : size) - starts[i];
+        int offset, count;
+
+        for (offset = 0; offset < lengths[i]; offset += count, rows++){
+            count = terminal_reflow_count(&cells[starts[i]], stored, lengths[i], offset, cols_number);
+            if (i == cursor_line && BETWEEN(cursor_offset, offset, offset + count - 1)){
+                cursor_row = rows;
+                cursor_x = cursor_offset - offset;
+            }
+        }
+    }
+
+    // the rows over the top go to the scrollback, but the cursor stays
+    // on the screen even if the rows under it do not.
+    skip = rows > rows_number ? rows - rows_number : 0;
+    if (skip > cursor_row){
+        skip = cursor_row;
+    }
+
+    terminal_destroy_lines(terminal);
 
     terminal->cols_number = cols_number;
     terminal->rows_number = rows_number;
 
+    ret = terminal_create_lines(terminal);
+    ASSERT_TO(fail_on_lines, (ret == 0), "failed to create screen lines.\n");
+
+    terminal_empty(terminal);
+
+    y = -skip;
+    for (i = 0; i < lines_number && y < rows_number; i++){
+        int stored = (i + 1 < lines_number ? starts[i + 1] : size) - starts[i];
+        int offset, count;
+
+        for (offset = 0; offset < lengths[i] && y < rows_number; offset += count, y++){
+            TElement* line;
+            int copied, wrapped;
+
+            count = terminal_reflow_count(&cells[starts[i]], stored, lengths[i], offset, cols_number);
+            copied = stored - offset < count ? stored - offset : count;
+            wrapped = offset + count < lengths[i];
+
+            if (copied < 0){
+                copied = 0;
+            }
+
+            if (y >= 0){
+                if (copied > 0){
+                    line = terminal_line_write(terminal, y);
+                    ASSERT_TO(fail_on_lines, line, "failed to write line.\n");
+                    memcpy(line, &cells[starts[i] + offset], sizeof(TElement) * copied);
+                }
+                if (wrapped && count < cols_number){
+                    line = terminal_line_write(terminal, y);
+                    ASSERT_TO(fail_on_lines, line, "failed to write line.\n");
+                    line[cols_number - 1].flags = ELEMENT_PAD;
+                }
+                *terminal_line_flags(terminal, y) = wrapped ? ROW_WRAPPED : 0;
+                continue;
+            }
+
+            // over the top.
+            line = (TElement*) malloc(sizeof(TElement) * (copied > 0 ? copied : 1));
+            if (line == NULL){
+                LOG_ERROR("failed to malloc scrollback line.\n");
+                continue;
+            }
+            memcpy(line, &cells[starts[i] + offset], sizeof(TElement) * copied);
+
+            ret = scrollback_push(terminal->scrollback, line, copied, wrapped);
+            if (ret != 0){
+                LOG_ERROR("failed to push line to scrollback.\n");
+            }
+        }
+    }
+
     terminal->top = 0;
     terminal->bottom = rows_number - 1;
 
-    terminal->cursor.x = 0;
-    terminal->cursor.y = 0;
-    terminal->start_line_index = 0;
+    terminal->cursor.x = cursor_x;
+    terminal->cursor.y = cursor_row - skip < rows_number ? cursor_row - skip : rows_number - 1;
+    terminal->wrap_pending = FALSE;
 
-    terminal->screen = (TElement*) malloc(sizeof(TElement) * cols_number * rows_number);
-    ASSERT(terminal->screen, "failed to malloc screen.\n");
+    if (terminal->saved_cursor.x >= cols_number){
+        terminal->saved_cursor.x = cols_number - 1;
+    }
+    if (terminal->saved_cursor.y >= rows_number){
+        terminal->saved_cursor.y = rows_number - 1;
+    }
 
-    terminal_empty(terminal);
+    free(cells);
+    free(starts);
+    free(lengths);
 
     // Notify shell change in size!
-    pty_resize( terminal->pty, 
-                terminal->cols_number,
-                terminal->rows_number);
+    if (terminal->pty){
+        pty_resize( terminal->pty, 
+                    terminal->cols_number,
+                    terminal->rows_number);
+    }
     return 0;
 
+fail_on_lines:
+    free(cells);
+    free(starts);
+    free(lengths);
 fail:
     return -1;
 }
 
+/*
+ * The cursor does not leave the last column right away, the next
+ * printable character wraps (see terminal_wrap()).
+ */
 int terminal_forward_cursor(Terminal* terminal){
     if (terminal->cursor.x + 1 < terminal->cols_number){
         terminal->cursor.x++;
-    // }else if (IS_VT_MODE(VT_DECAWM_MODE)){
-        // int ret;
-        // ret = terminal_new_line(terminal);
-        // ASSERT((ret == 0), "failed to create new line.\n");
-        // terminal->cursor.x = 0;
+    }else if (IS_VT_MODE(VT_DECAWM_MODE)){
+        terminal->wrap_pending = TRUE;
     }
     return 0;
+}
+
+/*
+ * The cells of row index of lines to be written. A blank row which has
+ * cells of its own from before it was erased has them blanked, one
+ * which never had any gets them.
+ */
+static TElement* terminal_materialize_line(Terminal* terminal, 
+                                           TElement** lines, 
+                                           unsigned int* generations,
+                                           unsigned int generation,
+                                           int index){
+    TElement* line = lines[index];
+
+    if (generations[index] == generation && line != terminal->blank_line){
+        return line;
+    }
+
+    if (line == terminal->blank_line){
+        line = (TElement*) malloc(sizeof(TElement) * terminal->cols_number);
+        ASSERT(line, "failed to malloc line.\n");
+        lines[index] = line;
+    }
+    terminal_fill_cells(line, 0, terminal->cols_number - 1, blank_element);
+    generations[index] = generation;
+    return line;
 
-// fail:
-    // return -1;
+fail:
+    return NULL;
 }
 
-int terminal_empty_element(Terminal* terminal, int x, int y){
-    TElement* element = NULL;
+TElement* terminal_line_write(Terminal* terminal, int y){
+    return terminal_materialize_line(terminal,
+                                     terminal->lines,
+                                     terminal->lines_generation,
+                                     terminal->generation,
+                                     terminal_line_index(terminal, y));
+}
+
+TElement* terminal_other_line_write(Terminal* terminal, int y){
+    return terminal_materialize_line(terminal,
+                                     terminal->other_lines,
+                                     terminal->other_lines_generation,
+                                     terminal->other_generation,
+                                     (terminal->other_start_line_index + y) % terminal->rows_number);
+}
+
+// whether row index of the screen is blank, without reading its cells.
+static inline int terminal_blank_index(Terminal* terminal, int index){
+    return terminal->lines_generation[index] != terminal->generation ||
+           terminal->lines[index] == terminal->blank_line;
+}
+
+// ------------------------------------------------------------
+// Grid kernels, every one damages a single span of the row.
+
+/*
+ * The cells from left to right are about to be written over, the half
+ * of a wide character which is left out of them is blanked.
+ */
+static inline void terminal_split_wide(Terminal* terminal, int y, int left, int right){
+    TElement* line = terminal_line(terminal, y);
+
+    if (left > 0 && line[left].character_code == ELEMENT_SPACER){
+        line[left - 1].character_code = BLANK_ELEMENT;
+        terminal_damage_cells(terminal, y, left - 1, left - 1);
+    }
+    if (right + 1 < terminal->cols_number && line[right + 1].character_code == ELEMENT_SPACER){
+        line[right + 1].character_code = BLANK_ELEMENT;
+        terminal_damage_cells(terminal, y, right + 1, right + 1);
+    }
+}
+
+/*
+ * Blanks cells [left, right] of row y, and the other half of a wide
+ * character cut by them. The flags of the row are kept.
+ */
+int terminal_erase_cells(Terminal* terminal, int y, int left, int right){
+    int index = terminal_line_index(terminal, y);
+    int first, last;
+
+    ASSERT((BETWEEN(left, 0, terminal->cols_number - 1)), 
+           "erase_cells -> parameter not in range.\n");
+    ASSERT((BETWEEN(right, left, terminal->cols_number - 1)), 
+           "erase_cells -> parameter not in range.\n");
+
+    // a blank row has nothing to erase, and only the cells which are
+    // not blank yet are damaged.
+    if (terminal_blank_index(terminal, index) ||
+        !terminal_diff_cells(terminal->lines[index], left, right, blank_element, &first, &last)){
+        return 0;
+    }
 
-    element = &terminal->screen[(y * terminal->cols_number) + x];
+    // a whole row is erased as terminal_empty_line() does.
+    if (left == 0 && right == terminal->cols_number - 1){
+        terminal->lines_generation[index] = terminal->generation - 1;
+    }else{
+        terminal_split_wide(terminal, y, left, right);
+        terminal_fill_cells(terminal->lines[index], first, last, blank_element);
+    }
 
-    element->character_code = BLANK_ELEMENT;
-    element->background_color = terminal->default_background_color;
-    element->foreground_color = terminal->default_foreground_color;
-    element->attributes = 0;
-    element->dirty = 1;
+    terminal_damage_cells(terminal, y, first, last);
     return 0;
+
+fail:
+    return -1;
+}
+
+int terminal_empty_element(Terminal* terminal, int x, int y){
+    return terminal_erase_cells(terminal, y, x, x);
 }
 
+// the row keeps its cells, they are blanked once it is written again.
 int terminal_empty_line(Terminal* terminal, int y){
-    for (int x = 0; x < terminal->cols_number; x++){
-        terminal_empty_element(terminal, x, y);
-    }
+    int index = terminal_line_index(terminal, y);
+
+    terminal->lines_generation[index] = terminal->generation - 1;
+    terminal->lines_flags[index] = 0;
 
+    terminal_damage_line(terminal, y);
     return 0;
 }
 
+// a new generation, every row becomes blank at once.
 int terminal_empty(Terminal* terminal){
-    int ret;
     int y;
 
+    // the rows which were blank already stay as they were drawn.
     for (y = 0; y < terminal->rows_number; y++){
-        ret = terminal_empty_line(terminal, y);
-        ASSERT(ret == 0, "failed to empty line\n");
+        if (!terminal_blank_index(terminal, terminal_line_index(terminal, y))){
+            terminal_damage_line(terminal, y);
+        }
+    }
+
+    terminal->generation++;
+    memset(terminal->lines_flags, 0, terminal->rows_number);
+    return 0;
+}
+
+/*
+ * Hands the top lines_number rows over to the scrollback and puts new
+ * rows in their place, the caller scrolls them to the bottom and 
+ * empties them.
+ */
+static int terminal_save_lines(Terminal* terminal, int lines_number){
+    TElement* saved;
+    int wrapped;
+    int index;
+    int ret;
+    int y;
+
+    for (y = 0; y < lines_number; y++){
+        index = LINE_INDEX(y);
+
+        // the trailing blanks of a wrapped row are part of its line.
+        wrapped = terminal->lines_flags[index] & ROW_WRAPPED;
+
+        // a blank row keeps its cells, the scrollback only takes 
+        // an empty line.
+        if (terminal_blank_index(terminal, index) && !wrapped){
+            ret = scrollback_push(terminal->scrollback, NULL, 0, 0);
+            ASSERT((ret == 0), "failed to push line to scrollback.\n");
+            continue;
+        }
+
+        saved = terminal_line_write(terminal, y);
+        ASSERT(saved, "failed to write line.\n");
+        terminal->lines[index] = terminal->blank_line;
+
+        ret = scrollback_push(terminal->scrollback, 
+                              saved, 
+                              wrapped ? terminal_wrapped_length(terminal, saved) : terminal_line_length(terminal, saved),
+                              wrapped);
+        ASSERT((ret == 0), "failed to push line to scrollback.\n");
     }
     return 0;
 
@@ -273,14 +895,31 @@ fail:
     return -1;
 }
 
+// the cursor goes to the start of the next row, the row it leaves is
+// marked as going on there.
+static int terminal_wrap(Terminal* terminal){
+    *terminal_line_flags(terminal, terminal->cursor.y) |= ROW_WRAPPED;
+    terminal->cursor.x = 0;
+
+    return terminal_new_line(terminal);
+}
+
 int terminal_new_line(Terminal* terminal){
     int ret;
 
-    if (terminal->cursor.y + 1 < terminal->rows_number){
-        terminal->cursor.y++;
-    }else{
+    terminal->wrap_pending = FALSE;
+
+    // the screen scrolls only at the bottom of the scrolling region,
+    // and only rows scrolled off the top of the primary screen are kept.
+    if (terminal->cursor.y == terminal->bottom){
+        if (terminal->top == 0 && !terminal->alternate){
+            ret = terminal_save_lines(terminal, 1);
+            ASSERT(ret == 0, "failed to save line.\n");
+        }
         ret = terminal_scrollup(terminal, terminal->top, terminal->bottom, 1);
         ASSERT(ret == 0, "failed to rotate lines in terminal.\n");
+    }else if (terminal->cursor.y + 1 < terminal->rows_number){
+        terminal->cursor.y++;
     }
 
     return 0;
@@ -297,60 +936,150 @@ int terminal_move_line(Terminal* terminal, int src_y, int dst_y){
     ASSERT((BETWEEN(dst_y, 0, terminal->rows_number)), 
             "dst_y is not in range.\n");
 
-    memcpy(&terminal->screen[dst_y * terminal->cols_number],
-           &terminal->screen[src_y * terminal->cols_number],
-           (sizeof(TElement) * terminal->cols_number));
-    
-    // mark destination as dirty.
-    for (int x = 0; x < terminal->cols_number; x++){
-        terminal->screen[(dst_y * terminal->cols_number) + x].dirty = 1;
+    // a blank row stays without cells.
+    if (terminal_blank_index(terminal, terminal_line_index(terminal, src_y))){
+        terminal->lines_generation[terminal_line_index(terminal, dst_y)] = terminal->generation - 1;
+    }else{
+        TElement* line = terminal_line_write(terminal, dst_y);
+        ASSERT(line, "failed to write line.\n");
+
+        memcpy(line,
+               terminal_line(terminal, src_y),
+               (sizeof(TElement) * terminal->cols_number));
     }
+    *terminal_line_flags(terminal, dst_y) = *terminal_line_flags(terminal, src_y);
+    
+    terminal_damage_line(terminal, dst_y);
 
     return 0;
 fail:
     return -1;
 }
 
+/*
+ * Inserts chars_number blanks at left, the cells up to right move right
+ * and the ones pushed past right are lost.
+ */
 int terminal_scroll_right(Terminal* terminal, int y, int left, int right, int chars_number){
-    return 0;
-}
+    TElement* line;
+    int last;
 
-int terminal_scroll_left(Terminal* terminal, int y, int left, int right, int chars_number){
     ASSERT((BETWEEN(left, 0, terminal->cols_number - 1)), 
-           "scroll_left -> parameter not in range.\n");
+           "scroll_right -> parameter not in range.\n");
     ASSERT((BETWEEN(right, left, terminal->cols_number - 1)), 
-           "scroll_left -> parameter not in range.\n");
-    ASSERT(BETWEEN(chars_number, 0, right - left), 
-           "chars number given is out of range.\n");
+           "scroll_right -> parameter not in range.\n");
+    ASSERT((chars_number >= 0), "chars number given is out of range.\n");
 
-    TElement* line = &terminal->screen[(y * terminal->cols_number)];
+    if (chars_number > right - left){
+        return terminal_erase_cells(terminal, y, left, right);
+    }
+    if (chars_number == 0 || terminal_blank_index(terminal, terminal_line_index(terminal, y))){
+        terminal_damage_cells(terminal, y, left, right);
+        return 0;
+    }
 
-    int dst = left;
-    int src = left + chars_number;
-    int size = right - src;
-    memmove(&line[dst], 
-            &line[src], 
-            sizeof(TElement) * size);
+    line = terminal_line_write(terminal, y);
+    ASSERT(line, "failed to write line.\n");
 
-    int i;
-
-    // mark destination as dirty
-    for (i = 0; i < size; i++){
-        line[dst + i].dirty = 1;
+    // a wide character cut at left, and the last one which keeps
+    // its cell but not its spacer, are blanked.
+    if (left > 0 && line[left].character_code == ELEMENT_SPACER){
+        line[left - 1].character_code = BLANK_ELEMENT;
+        line[left].character_code = BLANK_ELEMENT;
+        terminal_damage_cells(terminal, y, left - 1, left - 1);
+    }
+    last = right - chars_number;
+    if (line[last + 1].character_code == ELEMENT_SPACER){
+        line[last].character_code = BLANK_ELEMENT;
     }
 
-    for (i = 0; i < chars_number; i++){
-        terminal_empty_element(terminal, right - i, y);
+    memmove(&line[left + chars_number], &line[left], sizeof(TElement) * (last - left + 1));
+    terminal_fill_cells(line, left, left + chars_number - 1, blank_element);
+
+    terminal_damage_cells(terminal, y, left, right);
+    return 0;
+
+fail:
+    return -1;
+}
+
+/*
+ * Deletes chars_number cells at left, the cells up to right move left
+ * over them and blanks come in at right.
+ */
+int terminal_scroll_left(Terminal* terminal, int y, int left, int right, int chars_number){
+    TElement* line;
+
+    ASSERT((BETWEEN(left, 0, terminal->cols_number - 1)), 
+           "scroll_left -> parameter not in range.\n");
+    ASSERT((BETWEEN(right, left, terminal->cols_number - 1)), 
+           "scroll_left -> parameter not in range.\n");
+    ASSERT((chars_number >= 0), "chars number given is out of range.\n");
+
+    if (chars_number > right - left){
+        return terminal_erase_cells(terminal, y, left, right);
+    }
+    if (chars_number == 0 || terminal_blank_index(terminal, terminal_line_index(terminal, y))){
+        terminal_damage_cells(terminal, y, left, right);
+        return 0;
     }
 
+    line = terminal_line_write(terminal, y);
+    ASSERT(line, "failed to write line.\n");
+
+    terminal_split_wide(terminal, y, left, left + chars_number - 1);
+
+    memmove(&line[left], &line[left + chars_number], sizeof(TElement) * (right - left + 1 - chars_number));
+    line[right - chars_number].flags = 0; // a pad is no longer at the end.
+    terminal_fill_cells(line, right - chars_number + 1, right, blank_element);
+
+    terminal_damage_cells(terminal, y, left, right);
     return 0;
+
 fail:
     return -1;
 }
 
+/*
+ * Rotates rows [top_y, bottom_y] up by lines_number by moving row 
+ * pointers only, the whole screen is rotated by moving start_line_index.
+ */
+static void terminal_rotate_lines(Terminal* terminal, int top_y, int bottom_y, int lines_number){
+    TElement* line;
+    unsigned char flags;
+    unsigned int generation;
+    int a, b;
+    int step;
+
+    if (top_y == 0 && bottom_y == terminal->rows_number - 1){
+        terminal->start_line_index = LINE_INDEX(lines_number);
+        return;
+    }
+
+    // rotate by reversing [top, top + n), [top + n, bottom] and then all.
+    for (step = 0; step < 3; step++){
+        a = (step == 1) ? top_y + lines_number : top_y;
+        b = (step == 0) ? top_y + lines_number - 1 : bottom_y;
+
+        for (; a < b; a++, b--){
+            line = terminal->lines[LINE_INDEX(a)];
+            terminal->lines[LINE_INDEX(a)] = terminal->lines[LINE_INDEX(b)];
+            terminal->lines[LINE_INDEX(b)] = line;
+
+            flags = terminal->lines_flags[LINE_INDEX(a)];
+            terminal->lines_flags[LINE_INDEX(a)] = terminal->lines_flags[LINE_INDEX(b)];
+            terminal->lines_flags[LINE_INDEX(b)] = flags;
+
+            generation = terminal->lines_generation[LINE_INDEX(a)];
+            terminal->lines_generation[LINE_INDEX(a)] = terminal->lines_generation[LINE_INDEX(b)];
+            terminal->lines_generation[LINE_INDEX(b)] = generation;
+        }
+    }
+}
+
 int terminal_scrollup(Terminal* terminal, int top_y, int bottom_y, int lines_number){
     int ret;
-    int i;
+    int y;
 
     ASSERT((lines_number > 0), "lines number to scroll invalid.\n");
     ASSERT((BETWEEN(top_y, 0, terminal->rows_number - 1)),
@@ -358,24 +1087,19 @@ int terminal_scrollup(Terminal* terminal, int top_y, int bottom_y, int lines_num
     ASSERT((BETWEEN(bottom_y, top_y, terminal->rows_number - 1)),
            "starting scroll position is not in range.\n");
 
-    int left_lines = bottom_y - top_y - lines_number;
-
-    // we might not care about it 
-    // and can just empty all lines
-    ASSERT((left_lines >= 0), "too much to scroll.\n");
-
-    // the order is important here so we dont 
-    // override the lines we need to copy.
-    // so we move the lines from the end to the start.
-    for (i = 0; i <= left_lines; i++){
-        ret = terminal_move_line(   terminal,
-                                    (bottom_y - left_lines) + i,
-                                    top_y + i);
-        ASSERT(ret == 0, "failed to move line.\n");
+    // scrolling the whole region or more just empties it.
+    if (lines_number > bottom_y - top_y){
+        lines_number = bottom_y - top_y + 1;
+    }else{
+        terminal_rotate_lines(terminal, top_y, bottom_y, lines_number);
     }
 
-    for (i = 0; i < lines_number; i++){
-        ret = terminal_empty_line(terminal, bottom_y - i);
+    // the rows that scrolled out are reused at the bottom.
+    for (y = top_y; y <= bottom_y - lines_number; y++){
+        terminal_damage_line(terminal, y);
+    }
+    for (; y <= bottom_y; y++){
+        ret = terminal_empty_line(terminal, y);
         ASSERT(ret == 0, "failed to empty line.\n");
     }
 
@@ -386,7 +1110,7 @@ fail:
 
 int terminal_scrolldown(Terminal* terminal, int top_y, int bottom_y, int lines_number){
     int ret;
-    int i;
+    int y;
 
     ASSERT((lines_number > 0), "lines number to scroll invalid.\n");
     ASSERT((BETWEEN(top_y, 0, terminal->rows_number - 1)),
@@ -394,26 +1118,23 @@ int terminal_scrolldown(Terminal* terminal, int top_y, int bottom_y, int lines_n
     ASSERT((BETWEEN(bottom_y, top_y, terminal->rows_number - 1)),
            "starting scroll position is not in range.\n");
 
-    int left_lines = bottom_y - top_y - lines_number;
-
-    // we might not care about it 
-    // and can just empty all lines
-    ASSERT((left_lines >= 0), "too much to scroll\n");
-
-    // the order is important here so we dont 
-    // override the lines we need to copy.
-    // so we move the lines from the end to the start.
-    for (i = 0; i <= left_lines; i++){
-        ret = terminal_move_line(   terminal,
-                                    (top_y + left_lines) - i,
-                                    bottom_y - i);
-        ASSERT(ret == 0, "failed to move line.\n");
+    if (lines_number > bottom_y - top_y){
+        lines_number = bottom_y - top_y + 1;
+    }else{
+        // down by n is up by the rest of the region.
+        terminal_rotate_lines(terminal, 
+                              top_y, 
+                              bottom_y, 
+                              (bottom_y - top_y + 1) - lines_number);
     }
 
-    for (i = 0; i < lines_number; i++){
-        ret = terminal_empty_line(terminal, top_y + i);
+    for (y = top_y; y < top_y + lines_number; y++){
+        ret = terminal_empty_line(terminal, y);
         ASSERT(ret == 0, "failed to empty line.\n");
     }
+    for (; y <= bottom_y; y++){
+        terminal_damage_line(terminal, y);
+    }
 
     return 0;
 fail:
@@ -438,6 +1159,8 @@ void bel_handler(Terminal* terminal){
 void bs_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("bs_handler");
 
+    terminal->wrap_pending = FALSE;
+
     if (terminal->cursor.x > 0){
         terminal->cursor.x--;
     }
@@ -446,6 +1169,8 @@ void bs_handler(Terminal* terminal){
 void ht_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("ht_handler");
 
+    terminal->wrap_pending = FALSE;
+
     int max_x = terminal->cols_number - 1;
 
     int new_x = terminal->cursor.x + 8;
@@ -476,6 +1201,7 @@ void cr_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("cr_handler");
 
     terminal->cursor.x = 0; // return to start of line.
+    terminal->wrap_pending = FALSE;
     // if (TRUE){
         // terminal_new_line(terminal);
     // }
@@ -489,22 +1215,14 @@ void si_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("si_handler");
 }
 
+// the sequence itself is interrupted by the parser.
 void can_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("can_handler");
-
-    SET_NO_MODE(ESC_MODE); // interrupt esc sequence.
 }
 
+// the sequence itself is interrupted by the parser.
 void sub_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("sub_handler");
-
-    SET_NO_MODE(ESC_MODE); // interrupt esc sequence.
-}
-
-void esc_handler(Terminal* terminal){
-    DEBUG_ESC_HANDLER("esc_handler");
-
-    SET_MODE(ESC_MODE);
 }
 
 void del_handler(Terminal* terminal){
@@ -512,14 +1230,8 @@ void del_handler(Terminal* terminal){
     // ignored?
 }
 
-void csi_handler(Terminal* terminal){
-    DEBUG_ESC_HANDLER("csi_handler");
-
-    SET_MODE(CSI_MODE);
-}
-
-// 0x100 the maximum value of control code?
-void (*control_code_handlers[0x100])(Terminal* terminal) = {
+// C1 controls (0x80 - 0x9F) are handled as their ESC equivalents.
+void (*control_code_handlers[0x80])(Terminal* terminal) = {
     [0x00] = null_handler,
     [0x07] = bel_handler,
     [0x08] = bs_handler,
@@ -532,9 +1244,7 @@ void (*control_code_handlers[0x100])(Terminal* terminal) = {
     [0x0F] = si_handler,
     [0x18] = can_handler,
     [0x1A] = sub_handler,
-    [0x1B] = esc_handler,
-    [0x7F] = del_handler,
-    [0x9B] = csi_handler
+    [0x7F] = del_handler
 };
 
 // ----------------------------------------------------------------------
@@ -550,13 +1260,14 @@ void esc_ris_handler(Terminal* terminal){
 void esc_ind_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("esc_ind_handler");
 
-    // TODO: scroll window one line up
+    terminal_new_line(terminal);
 }
 
 void esc_nel_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("esc_nel_handler");
     
-    // TODO: moe to next line
+    terminal_new_line(terminal);
+    terminal->cursor.x = 0;
 }
 
 void esc_hts_handler(Terminal* terminal){
@@ -566,7 +1277,14 @@ void esc_hts_handler(Terminal* terminal){
 void esc_ri_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("esc_ri_handler");
 
-    // TODO: scroll window one line down
+    terminal->wrap_pending = FALSE;
+
+    // the screen scrolls only at the top of the scrolling region.
+    if (terminal->cursor.y == terminal->top){
+        terminal_scrolldown(terminal, terminal->top, terminal->bottom, 1);
+    }else if (terminal->cursor.y > 0){
+        terminal->cursor.y--;
+    }
 }
 
 void esc_decid_handler(Terminal* terminal){
@@ -579,27 +1297,13 @@ void esc_decsc_handler(Terminal* terminal){
 
 void esc_decrc_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("esc_decrc_handler");
-
-    if (IS_MODE(ESC_CHARSET_MODE)){
-        LOG("Set utf8 charset - obselete.\n");
-        return;
-    }
-}
-
-void esc_select_charset_handler(Terminal* terminal){
-    DEBUG_ESC_HANDLER("esc_select_charset_handler");
 }
 
-void esc_define_g0_charset_handler(Terminal* terminal){
-    DEBUG_ESC_HANDLER("esc_define_g0_charset_handler");
+void esc_st_handler(Terminal* terminal){
+    DEBUG_ESC_HANDLER("esc_st_handler");
 
-    SET_MODE(ESC_G0_MODE);
-}
-
-void esc_define_g1_charset_handler(Terminal* terminal){
-    DEBUG_ESC_HANDLER("esc_define_g1_charset_handler");
-
-    SET_MODE(ESC_G1_MODE);
+    // string terminator, the string itself 
+    // was ended by the parser on ESC.
 }
 
 void esc_decpnm_handler(Terminal* terminal){
@@ -614,71 +1318,64 @@ void esc_decpam_handler(Terminal* terminal){
     SET_VT_MODE(VT_DECKPAM_MODE);
 }
 
-void esc_osc_handler(Terminal* terminal){
-    DEBUG_ESC_HANDLER("esc_osc_handler");
-
-    SET_MODE(OSC_MODE);
-}
-
+// ESC ( <final> defines G0, ESC ) <final> defines G1.
 void esc_set_uk_charset_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("esc_set_uk_charset_handler");
 
-    if (!IS_MODE(ESC_G0_MODE) && !IS_MODE(ESC_G1_MODE)) return;
-
     RESET_CHARSET();
-    if (IS_MODE(ESC_G0_MODE)){
+    if (IS_INTERMEDIATE('(')){
         SET_CHARSET(CHARSET_G0_UK);
     }
-    if (IS_MODE(ESC_G1_MODE)){
+    if (IS_INTERMEDIATE(')')){
         SET_CHARSET(CHARSET_G1_UK);
     }
 }
 
 void esc_set_us_charset_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("esc_set_us_charset_handler");
-    if (!IS_MODE(ESC_G0_MODE) && !IS_MODE(ESC_G1_MODE)) return;
 
     RESET_CHARSET();
-
-    if (IS_MODE(ESC_G0_MODE)){
+    if (IS_INTERMEDIATE('(')){
         SET_CHARSET(CHARSET_G0_US);
     }
-    if (IS_MODE(ESC_G1_MODE)){
+    if (IS_INTERMEDIATE(')')){
         SET_CHARSET(CHARSET_G1_US);
     }
 }
 
 void esc_set_special_charset_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("esc_set_special_charset_handler");
-    if (!IS_MODE(ESC_G0_MODE) && !IS_MODE(ESC_G1_MODE)) return;
 
     RESET_CHARSET();
-    if (IS_MODE(ESC_G0_MODE)){
-        SET_MODE(CHARSET_G0_SPECIAL);
+    if (IS_INTERMEDIATE('(')){
+        SET_CHARSET(CHARSET_G0_SPECIAL);
     }
-    if (IS_MODE(ESC_G1_MODE)){
-        SET_MODE(CHARSET_G1_SPECIAL);
+    if (IS_INTERMEDIATE(')')){
+        SET_CHARSET(CHARSET_G1_SPECIAL);
     }
 }
 
+// ESC % <final> selects the charset.
 void esc_set_default_charset_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("esc_set_default_charset_handler");
-    if (!IS_MODE(ESC_CHARSET_MODE)) return;
 }
 
 void esc_set_utf8_charset_handler(Terminal* terminal){
     DEBUG_ESC_HANDLER("esc_set_utf8_charset_handler");
-    if (!IS_MODE(ESC_CHARSET_MODE)) return;
 }
 
-void (*esc_code_handlers[100])(Terminal* terminal) = {
+void (*esc_charset_handlers[0x80])(Terminal* terminal) = {
     ['A'] = esc_set_uk_charset_handler,
     ['B'] = esc_set_us_charset_handler,
-    ['0'] = esc_set_special_charset_handler,
+    ['0'] = esc_set_special_charset_handler
+};
 
+void (*esc_select_charset_handlers[0x80])(Terminal* terminal) = {
     ['@'] = esc_set_default_charset_handler,
-    ['G'] = esc_set_utf8_charset_handler,
+    ['G'] = esc_set_utf8_charset_handler
+};
 
+void (*esc_code_handlers[0x80])(Terminal* terminal) = {
     ['c'] = esc_ris_handler,
     ['D'] = esc_ind_handler,
     ['E'] = esc_nel_handler,
@@ -687,13 +1384,9 @@ void (*esc_code_handlers[100])(Terminal* terminal) = {
     ['Z'] = esc_decid_handler,
     ['7'] = esc_decsc_handler,
     ['8'] = esc_decrc_handler,
-    ['['] = csi_handler,
-    ['%'] = esc_select_charset_handler,
-    ['('] = esc_define_g0_charset_handler,
-    [')'] = esc_define_g1_charset_handler,
     ['>'] = esc_decpnm_handler,
     ['='] = esc_decpam_handler,
-    [']'] = esc_osc_handler
+    ['\\'] = esc_st_handler
 };
 
 // ----------------------------------------------------------------------
@@ -702,79 +1395,45 @@ void (*esc_code_handlers[100])(Terminal* terminal) = {
 // helper functions
 // ----------------------------------------------------------------------
 
+/*
+ * Returns the parameters of the current sequence, which were 
+ * accumulated by param_action(), or NULL if there are none.
+ */
 int* csi_get_parameters(Terminal* terminal, int* len){
-    int* parameters = NULL;
-    int i;
-
-    if (terminal->csi_parameters_index == 0){ 
+    if (terminal->csi_parameters_index < 0){
+        *len = 0;
         return NULL;
     }
 
-    parameters = (int*) malloc(sizeof(int) * CSI_MAX_PARAMETERS_CHARS);
-    memset(parameters, 0, sizeof(int) * CSI_MAX_PARAMETERS_CHARS);
-
-    *len = 0;
-    int parameters_start_index = 0;
-
-    i = 0;
-    if (terminal->csi_parameters[0] == '?'){
-        SET_MODE(PRIVATE_MODE);
-        i = 1; // skip question mark
-    }
-
-    for (; i < terminal->csi_parameters_index; i++){
-        if (terminal->csi_parameters[i] == ';'){
-            // null terminating the current parameter.
-            terminal->csi_parameters[i] = 0;
-
-            // Convert parameter to int:
-            // NOTE: atoi is returning 0 when empty string ("") is given, 
-            // which is exactly what we need.
-            parameters[(*len)] = atoi((char*) &terminal->csi_parameters[parameters_start_index]);
-
-            // setting paramete_start_index to next parameter
-            parameters_start_index = i + 1;
-            
-            (*len)++;
-        }
-    }
-
-    // if parameters didn't ended with ';'
-    if (parameters_start_index < terminal->csi_parameters_index){
-        // null terminating the current parameter.
-        terminal->csi_parameters[i] = 0;
-        // convert parameter to int.
-        parameters[(*len)] = atoi((char*) &terminal->csi_parameters[parameters_start_index]);
-
-        (*len)++;
-    }
-
-    // reset terminal's csi_parameters (they are not valid any more).
-    memset(terminal->csi_parameters, 0, sizeof(terminal->csi_parameters));
-    terminal->csi_parameters_index = 0;
-
-    if (*len == 0){
-        SET_NO_MODE(PRIVATE_MODE);
-        free(parameters);
-        parameters = NULL;
+    *len = terminal->csi_parameters_index + 1;
+    if (*len > CSI_MAX_PARAMETERS){
+        *len = CSI_MAX_PARAMETERS;
     }
 
-    return parameters;
+    return terminal->csi_parameters;
 }
 
-void csi_free_parameters(int* parameters){
-    if (parameters){
-        free(parameters);
+/*
+ * Returns the number of sub parameters (separated by ':') 
+ * that follows the parameter at index.
+ */
+int csi_get_subparameters_number(Terminal* terminal, int index, int len){
+    int number = 0;
+
+    while ((index + number + 1 < len) && 
+           (IS_SUBPARAMETER(index + number + 1))){
+        number++;
     }
+    return number;
 }
 
 void csi_log_parameters(int* parameters, int len){
     int i;
-    LOG("csi parameters: ");
+    LOG_DEBUG("csi parameters: ");
     for (i = 0; i < len; i++){
-        LOG("%d;", parameters[i]);
+        LOG_DEBUG("%d;", parameters[i]);
     }
-    LOG("\n");
+    LOG_DEBUG("\n");
 }
 
 // ----------------------------------------------------------------------
@@ -984,6 +1643,29 @@ int (*sgr_code_handlers[108])(Terminal* terminal, int* parameters, int left) = {
 
 void csi_ich_handler(Terminal* terminal){
     DEBUG_CSI_HANDLER("csi_ich_handler");
+
+    int ret;
+    int len = 0;
+    int* parameters = NULL;
+    int chars_number;
+
+    parameters = csi_get_parameters(terminal, &len);
+    if (parameters == NULL || parameters[0] == 0){
+        chars_number = 1;
+    }else{
+        ASSERT((len == 1), "csi_ich -> number of parameters is: %d\n", len);
+        chars_number = parameters[0];
+    }
+
+    ret = terminal_scroll_right(terminal, 
+                                terminal->cursor.y, 
+                                terminal->cursor.x, 
+                                terminal->cols_number - 1, 
+                                chars_number);
+    ASSERT(ret == 0, "failed to scroll right.\n");
+
+fail:
+    return;
 }
 
 void csi_cuu_handler(Terminal* terminal){
@@ -1007,9 +1689,10 @@ void csi_cuu_handler(Terminal* terminal){
            "cuu -> number of rows exceed limit.\n");
 
     terminal->cursor.y -= rows_number;
+    terminal->wrap_pending = FALSE;
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_cud_handler(Terminal* terminal){
@@ -1033,9 +1716,10 @@ void csi_cud_handler(Terminal* terminal){
            "cud -> number of rows exceed limit.\n");
 
     terminal->cursor.y += rows_number;
+    terminal->wrap_pending = FALSE;
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_cuf_handler(Terminal* terminal){
@@ -1059,9 +1743,10 @@ void csi_cuf_handler(Terminal* terminal){
            "cuf -> number of cols exceed limit.\n");
 
     terminal->cursor.x += cols_number;
+    terminal->wrap_pending = FALSE;
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_cub_handler(Terminal* terminal){
@@ -1085,9 +1770,10 @@ void csi_cub_handler(Terminal* terminal){
            "cub -> number of cols exceed limit.\n");
 
     terminal->cursor.x -= cols_number;
+    terminal->wrap_pending = FALSE;
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_cnl_handler(Terminal* terminal){
@@ -1112,6 +1798,7 @@ void csi_cup_handler(Terminal* terminal){
     if (parameters == NULL){
         terminal->cursor.x = 0;
         terminal->cursor.y = 0;
+        terminal->wrap_pending = FALSE;
         return;
     }
 
@@ -1125,9 +1812,9 @@ void csi_cup_handler(Terminal* terminal){
 
     terminal->cursor.x = col;
     terminal->cursor.y = row;
+    terminal->wrap_pending = FALSE;
 
 fail:
-    csi_free_parameters(parameters);
     return;
 }
 
@@ -1149,12 +1836,11 @@ void csi_ed_handler(Terminal* terminal){
     }
     
     if (todo == 0){ // from cursor to end of display
-        for (i = terminal->cursor.x; i < terminal->cols_number; i++){
-            ret = terminal_empty_element(  terminal, 
-                                            i, 
-                                            terminal->cursor.y);
-            ASSERT(ret == 0, "failed to delete element.\n");
-        }
+        ret = terminal_erase_cells(terminal, 
+                                   terminal->cursor.y, 
+                                   terminal->cursor.x, 
+                                   terminal->cols_number - 1);
+        ASSERT(ret == 0, "failed to erase cells.\n");
         for (i = terminal->cursor.y + 1; i < terminal->rows_number; i++){
             ret = terminal_empty_line(terminal, i);
             ASSERT(ret == 0, "failed to empty line.\n");
@@ -1165,12 +1851,8 @@ void csi_ed_handler(Terminal* terminal){
             ret = terminal_empty_line(terminal, i);
             ASSERT(ret == 0, "failed to empty line.\n");
         }
-        for (i = 0; i <= terminal->cursor.x; i++){
-            ret = terminal_empty_element(  terminal, 
-                                            i, 
-                                            terminal->cursor.y);
-            ASSERT(ret == 0, "failed to delete element.\n");
-        }
+        ret = terminal_erase_cells(terminal, terminal->cursor.y, 0, terminal->cursor.x);
+        ASSERT(ret == 0, "failed to erase cells.\n");
     } 
     if (todo == 2){ // all display
         ret = terminal_empty(terminal);
@@ -1179,11 +1861,10 @@ void csi_ed_handler(Terminal* terminal){
     if (todo == 3){ // all display + scrollback
         ret = terminal_empty(terminal);
         ASSERT(ret == 0, "failed to empty terminal.\n");
-        // TODO erase scrollback when we have one.
+        scrollback_clear(terminal->scrollback);
     }
 
 fail:
-    csi_free_parameters(parameters);
     return;
 }
 
@@ -1197,26 +1878,19 @@ void csi_el_handler(Terminal* terminal){
 
     // default: from cursor to end of line 
     if ((parameters == NULL) || (parameters[0] == 0)){ // default.
-        int i;
-        for (i = terminal->cursor.x; i < terminal->cols_number; i++){
-            ret = terminal_empty_element(  terminal, 
-                                            i, 
-                                            terminal->cursor.y);
-            ASSERT(ret == 0, "failed to delete element.\n");
-        }
+        ret = terminal_erase_cells(terminal, 
+                                   terminal->cursor.y, 
+                                   terminal->cursor.x, 
+                                   terminal->cols_number - 1);
+        ASSERT(ret == 0, "failed to erase cells.\n");
         return;
     }
     
     ASSERT((len == 1), "number of parameters is not 1.\n");
 
     if (parameters[0] == 1){ // from start to cursor
-        int i;
-        for (i = 0; i <= terminal->cursor.x; i++){
-            ret = terminal_empty_element(  terminal, 
-                                            i, 
-                                            terminal->cursor.y);
-            ASSERT(ret == 0, "failed to delete element.\n");
-        }
+        ret = terminal_erase_cells(terminal, terminal->cursor.y, 0, terminal->cursor.x);
+        ASSERT(ret == 0, "failed to erase cells.\n");
     } 
     if (parameters[0] == 2){ // all line
         ret = terminal_empty_line(terminal, terminal->cursor.y);
@@ -1224,7 +1898,7 @@ void csi_el_handler(Terminal* terminal){
     }
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_il_handler(Terminal* terminal){
@@ -1245,6 +1919,11 @@ void csi_il_handler(Terminal* terminal){
 
     ASSERT((len <= 1), "too many parameters.\n");
 
+    // no effect outside of the scrolling region.
+    if (!BETWEEN(terminal->cursor.y, terminal->top, terminal->bottom)){
+        return;
+    }
+
     ret = terminal_scrolldown(  terminal, 
                                 terminal->cursor.y, 
                                 terminal->bottom,
@@ -1252,7 +1931,7 @@ void csi_il_handler(Terminal* terminal){
     ASSERT(ret == 0, "failed to scroll down.\n");
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_dl_handler(Terminal* terminal){
@@ -1273,6 +1952,11 @@ void csi_dl_handler(Terminal* terminal){
 
     ASSERT((len <= 1), "too many parameters.\n");
 
+    // no effect outside of the scrolling region.
+    if (!BETWEEN(terminal->cursor.y, terminal->top, terminal->bottom)){
+        return;
+    }
+
     ret = terminal_scrollup(    terminal, 
                                 terminal->cursor.y, 
                                 terminal->bottom,
@@ -1280,7 +1964,7 @@ void csi_dl_handler(Terminal* terminal){
     ASSERT(ret == 0, "failed to scroll up.\n");
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_dch_handler(Terminal* terminal){
@@ -1304,13 +1988,13 @@ void csi_dch_handler(Terminal* terminal){
     int left = terminal->cursor.x;
     int right = terminal->cols_number - 1;
 
-    LOG("left: %d, right: %d\n", left, right);
+    LOG_TRACE("left: %d, right: %d\n", left, right);
 
     ret = terminal_scroll_left(terminal, terminal->cursor.y, left, right, chars_number);
     ASSERT(ret == 0, "failed to scroll left.\n");
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_ech_handler(Terminal* terminal){
@@ -1325,27 +2009,23 @@ void csi_ech_handler(Terminal* terminal){
         chars_number = 1; // ther default.
     }else{
         ASSERT((len == 1), "csi_ech_handler number of parameters is: %d\n", len);
-
-        // max
-        int max_chars = terminal->cols_number - 1 - terminal->cursor.x;
-
-        ASSERT(BETWEEN(parameters[0], 1, max_chars),
-               "the parameter of csi_ech is not in range\n");
-
         chars_number = parameters[0];
     }
 
-    int ret;
-    int i; 
-    for (i = 0; i < chars_number; i++){
-        ret = terminal_empty_element(   terminal, 
-                                        terminal->cursor.x + i,
-                                        terminal->cursor.y);
-        ASSERT(ret == 0, "csi_ech failed to empty element.\n");
+    // up to the end of the row.
+    if (chars_number > terminal->cols_number - terminal->cursor.x){
+        chars_number = terminal->cols_number - terminal->cursor.x;
     }
 
+    int ret;
+    ret = terminal_erase_cells(terminal, 
+                               terminal->cursor.y, 
+                               terminal->cursor.x, 
+                               terminal->cursor.x + chars_number - 1);
+    ASSERT(ret == 0, "csi_ech failed to erase cells.\n");
+
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_hpr_handler(Terminal* terminal){
@@ -1386,7 +2066,7 @@ void csi_sm_handler(Terminal* terminal){
 
     ASSERT((len == 1), "number of parameters is not 1?\n");
 
-    if (IS_MODE(PRIVATE_MODE)){
+    if (IS_PRIVATE()){
         if (parameters[0] == 1){
             SET_VT_MODE(VT_DECCKM_MODE);
         }
@@ -1417,14 +2097,22 @@ void csi_sm_handler(Terminal* terminal){
         if (parameters[0] == 25){
             // TODO show cursor.
         }
-        if (parameters[0] == 1049){
-            terminal->saved_cursor.x = terminal->cursor.x;
-            terminal->saved_cursor.y = terminal->cursor.y;
+        if (parameters[0] == 2026){
+            SET_VT_MODE(VT_SYNC_MODE);
+        }
+        // the alternate screen, 1049 also saves the cursor and clears it.
+        if ((parameters[0] == 47 || parameters[0] == 1047 || parameters[0] == 1049) &&
+            !terminal->alternate){
+            if (parameters[0] == 1049){
+                terminal->saved_cursor.x = terminal->cursor.x;
+                terminal->saved_cursor.y = terminal->cursor.y;
+            }
+            terminal_swap_screens(terminal);
+            if (parameters[0] == 1049){
+                terminal_empty(terminal);
+            }
         }
         // any other is ignored.
-
-
-        SET_NO_MODE(PRIVATE_MODE);
     }else{
         if (parameters[0] == 20){
             SET_VT_MODE(VT_LMN_MODE);
@@ -1432,7 +2120,7 @@ void csi_sm_handler(Terminal* terminal){
     }
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_rm_handler(Terminal* terminal){
@@ -1449,7 +2137,7 @@ void csi_rm_handler(Terminal* terminal){
 
     ASSERT((len == 1), "number of parameters is not 1?\n");
 
-    if (IS_MODE(PRIVATE_MODE)){
+    if (IS_PRIVATE()){
         if (parameters[0] == 1){
             SET_NO_VT_MODE(VT_DECCKM_MODE);
         }
@@ -1480,14 +2168,23 @@ void csi_rm_handler(Terminal* terminal){
         if (parameters[0] == 25){
             // TODO hide cursor.
         }
-        if (parameters[0] == 1049){
-            terminal->cursor.x = terminal->saved_cursor.x;
-            terminal->cursor.y = terminal->saved_cursor.y;
+        if (parameters[0] == 2026){
+            SET_NO_VT_MODE(VT_SYNC_MODE);
+        }
+        // back to the primary screen, 1047 clears the alternate one 
+        // first and 1049 restores the cursor.
+        if ((parameters[0] == 47 || parameters[0] == 1047 || parameters[0] == 1049) &&
+            terminal->alternate){
+            if (parameters[0] == 1047){
+                terminal_empty(terminal);
+            }
+            terminal_swap_screens(terminal);
+            if (parameters[0] == 1049){
+                terminal->cursor.x = terminal->saved_cursor.x;
+                terminal->cursor.y = terminal->saved_cursor.y;
+            }
         }
         // any other is ignored.
-
-
-        SET_NO_MODE(PRIVATE_MODE);
     }else{
         if (parameters[0] == 20){
             SET_NO_VT_MODE(VT_LMN_MODE);
@@ -1495,7 +2192,7 @@ void csi_rm_handler(Terminal* terminal){
     }
 
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_sgr_handler(Terminal* terminal){
@@ -1511,31 +2208,54 @@ void csi_sgr_handler(Terminal* terminal){
     // reset attributes when no parameters provided.
     if (parameters == NULL){ 
         sgr_reset_attributes_handler(terminal, NULL, 0);
+        terminal_update_style(terminal);
         return;
     }
 
     for (i = 0; i < len; i++){
         int left = len - i;
+        int* current = &parameters[i];
+        int subparameters = csi_get_subparameters_number(terminal, i, len);
 
         // to prevent out of bound.
-        ASSERT((BETWEEN(parameters[i], 0, 199)),
+        ASSERT((BETWEEN(parameters[i], 0, LENGTH(sgr_code_handlers) - 1)),
                "sgr parameter is not in range.\n");
 
         ASSERT(sgr_code_handlers[parameters[i]], 
                "handler to sgr parameter does not exist: %d.\n", 
                             parameters[i]);
 
-        ret = (sgr_code_handlers[parameters[i]])(terminal,
-                                                 &parameters[i],
-                                                 left);
+        if (subparameters > 0){
+            // sub parameters belong only to the current parameter.
+            left = subparameters + 1;
+
+            // 38:2:<color space id>:r:g:b -> the color space id is 
+            // ignored, shift the parameters over it to get 38;2;r;g;b.
+            if ((subparameters >= 5) && (parameters[i + 1] == 2)){
+                parameters[i + 2] = parameters[i + 1];
+                parameters[i + 1] = parameters[i];
+                current = &parameters[i + 1];
+                left--;
+            }
+        }
+
+        ret = (sgr_code_handlers[*current])(terminal,
+                                            current,
+                                            left);
         ASSERT((ret >= 0), "handler failed for parameter: %d\n",
                             parameters[i]);
 
+        if (subparameters > 0){
+            ret = subparameters;
+        }
+
         i += ret; // continue to next parameters.
     }
 
 fail:
-    csi_free_parameters(parameters);
+    // whatever was applied before a failure still takes effect.
+    terminal_update_style(terminal);
+    return;
 }
 
 void csi_dsr_handler(Terminal* terminal){
@@ -1547,8 +2267,8 @@ void csi_dsr_handler(Terminal* terminal){
     parameters = csi_get_parameters(terminal, &len);
     ASSERT(parameters, "dsr -> no csi parameters.\n");
 
-    // report cursor position.
-    if (parameters[0] == 6){
+    // report cursor position (nowhere to report without a pty).
+    if (parameters[0] == 6 && terminal->pty){
         char buf[100];
         int buf_len;
         int ret;
@@ -1560,11 +2280,77 @@ void csi_dsr_handler(Terminal* terminal){
         ret = pty_write(terminal->pty, 
                         buf,
                         buf_len);
-        ASSERT_TO(fail_on_pty_write, (ret >= 0), "dsr -> failed to write to pty.\n");
+        ASSERT((ret >= 0), "dsr -> failed to write to pty.\n");
+    }
+
+fail:
+    return;
+}
+
+// DECRQM state of a mode: 0 unknown, 1 set or 2 reset.
+static int terminal_mode_state(Terminal* terminal, int private, int mode){
+    unsigned int flag = 0;
+
+    if (private){
+        switch (mode){
+            case 1:     flag = VT_DECCKM_MODE; break;
+            case 2:     flag = VT_DECANM_MODE; break;
+            case 3:     flag = VT_DECCOLM_MODE; break;
+            case 4:     flag = VT_DECSCLM_MODE; break;
+            case 5:     flag = VT_DECSCNM_MODE; break;
+            case 6:     flag = VT_DECOM_MODE; break;
+            case 7:     flag = VT_DECAWM_MODE; break;
+            case 8:     flag = VT_DECARM_MODE; break;
+            case 9:     flag = VT_DECINLM_MODE; break;
+            case 2026:  flag = VT_SYNC_MODE; break;
+
+            case 47:
+            case 1047:
+            case 1049:
+                return terminal->alternate ? 1 : 2;
+        }
+    }else if (mode == 20){
+        flag = VT_LMN_MODE;
+    }
+
+    if (flag == 0){
+        return 0;
+    }
+    return IS_VT_MODE(flag) ? 1 : 2;
+}
+
+// DECRQM, CSI [?] Ps $ p is replied with CSI [?] Ps ; state $ y.
+void csi_decrqm_handler(Terminal* terminal){
+    DEBUG_CSI_HANDLER("csi_decrqm_handler");
+
+    int len;
+    int* parameters = NULL;
+
+    if (!IS_INTERMEDIATE('$')){
+        return;
+    }
+
+    parameters = csi_get_parameters(terminal, &len);
+    ASSERT(parameters, "decrqm -> no csi parameters.\n");
+
+    // nowhere to report without a pty.
+    if (terminal->pty){
+        char buf[100];
+        int buf_len;
+        int ret;
+
+        buf_len = sprintf(  buf,
+                            "\033[%s%d;%d$y",
+                            IS_PRIVATE() ? "?" : "",
+                            parameters[0],
+                            terminal_mode_state(terminal, IS_PRIVATE(), parameters[0]));
+
+        ret = pty_write(terminal->pty,
+                        buf,
+                        buf_len);
+        ASSERT((ret >= 0), "decrqm -> failed to write to pty.\n");
     }
 
-fail_on_pty_write:
-    csi_free_parameters(parameters);
 fail:
     return;
 }
@@ -1573,7 +2359,7 @@ void csi_decll_handler(Terminal* terminal){
     DEBUG_CSI_HANDLER("csi_decll_handler");
 
     // DECSCUSR -> change cursor style.
-    if (IS_MODE(CSI_SPACE_MODE)){ 
+    if (IS_INTERMEDIATE(' ')){ 
         return;
     }
 }
@@ -1606,8 +2392,13 @@ void csi_decstbm_handler(Terminal* terminal){
     terminal->top = top;
     terminal->bottom = bottom;
 
+    // cursor goes home.
+    terminal->cursor.x = 0;
+    terminal->cursor.y = 0;
+    terminal->wrap_pending = FALSE;
+
 fail:
-    csi_free_parameters(parameters);
+    return;
 }
 
 void csi_save_cursor_handler(Terminal* terminal){
@@ -1622,15 +2413,7 @@ void csi_hpa_handler(Terminal* terminal){
     DEBUG_CSI_HANDLER("csi_hpa_handler");
 }
 
-void csi_space_handler(Terminal* terminal){
-    DEBUG_CSI_HANDLER("csi_space_handler");
-
-    SET_MODE(CSI_SPACE_MODE);
-}
-
-void (*csi_code_handlers[200])(Terminal* terminal) = {
-    [' '] = csi_space_handler,
-
+void (*csi_code_handlers[0x80])(Terminal* terminal) = {
     ['@'] = csi_ich_handler,
     ['A'] = csi_cuu_handler,
     ['B'] = csi_cud_handler,
@@ -1656,6 +2439,7 @@ void (*csi_code_handlers[200])(Terminal* terminal) = {
     ['l'] = csi_rm_handler,
     ['m'] = csi_sgr_handler,
     ['n'] = csi_dsr_handler,
+    ['p'] = csi_decrqm_handler,
     ['q'] = csi_decll_handler,
     ['r'] = csi_decstbm_handler,
     ['s'] = csi_save_cursor_handler,
@@ -1666,193 +2450,196 @@ void (*csi_code_handlers[200])(Terminal* terminal) = {
 // ----------------------------------------------------------------------
 
 // ----------------------------------------------------------------------
-// Top level handlers
+// Parser actions
 // ----------------------------------------------------------------------
 
-int handle_osc_codes(Terminal* terminal, unsigned char control_code){
-    if (!IS_MODE(OSC_MODE)){
-        return FALSE;
-    }
-
-    // did end?
-    if ((control_code == 0x7) || 
-        (control_code == '\\')){
-
-        LOG("osc -> string: \"%s\".\n", terminal->osc_buffer);
-
-        // TODO: handle osc commands
+void ignore_action(Terminal* terminal, unsigned int character_code){
+}
 
-        SET_NO_MODE(OSC_MODE);
-        SET_NO_MODE(ESC_MODE);
+/*
+ * The cell of the character right before the cursor, which a combining
+ * character goes on, -1 if there is none.
+ */
+static int terminal_previous_cell(Terminal* terminal){
+    TElement* line = terminal_line(terminal, terminal->cursor.y);
+    int x = terminal->cursor.x;
+
+    // a pending wrap leaves the cursor on the last character.
+    if (!terminal->wrap_pending){
+        if (x == 0){
+            return -1;
+        }
+        x--;
+    }
+    if (x > 0 && line[x].character_code == ELEMENT_SPACER){
+        x--;
+    }
+    return x;
+}
 
-        memset(terminal->osc_buffer, 0, sizeof(terminal->osc_buffer));
-        terminal->osc_buffer_index = 0;
+// the cell the character goes on, -1 if it starts a cell of its own.
+static int terminal_joins(Terminal* terminal, unsigned int character_code){
+    unsigned int* codes;
+    int length;
+    int x;
 
-        return TRUE;
+    x = terminal_previous_cell(terminal);
+    if (x < 0){
+        return -1;
     }
+    length = terminal_codes(terminal, &terminal_line(terminal, terminal->cursor.y)[x], &codes);
+    return cluster_extends(codes, length, character_code) ? x : -1;
+}
 
-    ASSERT((terminal->osc_buffer_index + 1 < OSC_MAX_CHARS), 
-            "osc -> number of string exceeded limit.\n");
-    LOG("osc -> string: \"%s\".\n", terminal->osc_buffer);
+// the id of the cluster with ELEMENT_CLUSTER, 0 if there is no room.
+static unsigned int terminal_intern_cluster(Terminal* terminal, unsigned int* codes, int length){
+    int id;
 
-    terminal->osc_buffer[terminal->osc_buffer_index] = control_code;
-    terminal->osc_buffer_index++;
+    id = cluster_intern(terminal->clusters, codes, length);
+    if (id < 0){
+        // make room, and grow when most of the clusters are still used
+        // so the next collection is not right around the corner.
+        terminal_collect_clusters(terminal);
+        if (terminal->clusters->clusters_number > terminal->clusters->capacity / 2 &&
+            terminal->clusters->capacity < CLUSTERS_MAX){
+            cluster_table_grow(terminal->clusters);
+        }
 
-    return TRUE;
+        id = cluster_intern(terminal->clusters, codes, length);
+        ASSERT((id >= 0), "cluster table is full.\n");
+    }
+    return ELEMENT_CLUSTER | id;
 
 fail:
-    LOG("osc handler failed..?\n");
-    return TRUE;
+    return 0;
 }
 
-int handle_csi_codes(Terminal* terminal, unsigned char control_code){
-    if (!IS_MODE(CSI_MODE)){
-        return FALSE;
+/*
+ * Adds the character to the cluster of the cell at x of the cursor row,
+ * the cursor does not move.
+ */
+static void terminal_join_cell(Terminal* terminal, int x, unsigned int character_code){
+    TElement* line = terminal_line_write(terminal, terminal->cursor.y);
+    unsigned int codes[CLUSTER_CODES_MAX];
+    unsigned int* cell_codes;
+    unsigned int cluster;
+    int length;
+    int right = x;
+
+    if (line == NULL){
+        return;
     }
 
-    // handle parameters.
-    if (BETWEEN(control_code, 0x30, 0x3F)){
-
-        // did we reached the maximum number of parameters
-        if (terminal->csi_parameters_index == CSI_MAX_PARAMETERS_CHARS){
-            memset(&terminal->csi_parameters, 0, sizeof(terminal->csi_parameters));
-            terminal->csi_parameters_index = 0;
-
-            SET_NO_MODE(CSI_MODE);
-            SET_NO_MODE(ESC_MODE);
-
-            LOG("too much parameters.\n");
-
-            return FALSE;
-        }
-        terminal->csi_parameters[terminal->csi_parameters_index] = control_code;
-        terminal->csi_parameters_index++;
-
-        return TRUE;
+    // copied, interning may collect the cluster of the cell.
+    length = terminal_codes(terminal, &line[x], &cell_codes);
+    if (length == CLUSTER_CODES_MAX){
+        return;
     }
+    memcpy(codes, cell_codes, sizeof(unsigned int) * length);
+    codes[length++] = character_code;
 
-    // NOTE: these characters will only come after numbers.
-    // 0x20 <= control_code <= 0x2F
-    // intermediate characters of csi.
-    if (BETWEEN(control_code, 0x20, 0x2F)){
-        if (csi_code_handlers[control_code]){
-            (csi_code_handlers[control_code])(terminal);
-        }else{
-            LOG("csi handler wasn't found for: %d\n", control_code);
-            LOG("parameters for debuging: \"%s\".\n", terminal->csi_parameters);
-        }
-        return TRUE;
+    cluster = terminal_intern_cluster(terminal, codes, length);
+    if (cluster == 0){
+        return;
     }
+    line[x].character_code = cluster;
 
-    if (BETWEEN(control_code, 0x40, 0x7E)){
-        if (csi_code_handlers[control_code]){
-            (csi_code_handlers[control_code])(terminal);
-        }else{
-            LOG("csi handler wasn't found for: %d\n", control_code);
-            LOG("parameters for debuging: \"%s\".\n", terminal->csi_parameters);
-        }
-
-        memset(&terminal->csi_parameters, 0, sizeof(terminal->csi_parameters));
-        terminal->csi_parameters_index = 0;
-
-        SET_NO_MODE(CSI_SPACE_MODE);
-        SET_NO_MODE(PRIVATE_MODE);
-        SET_NO_MODE(CSI_MODE);
-        SET_NO_MODE(ESC_MODE);
-
-        return TRUE;
+    if (x + 1 < terminal->cols_number && line[x + 1].character_code == ELEMENT_SPACER){
+        right = x + 1;
     }
-    LOG("csi -> control code is out of range: %d.\n", control_code);
-    LOG("csi -> parameters for debuging: \"%s\".\n", terminal->csi_parameters);
-
-    memset(&terminal->csi_parameters, 0, sizeof(terminal->csi_parameters));
-    terminal->csi_parameters_index = 0;
-
-    SET_NO_MODE(PRIVATE_MODE);
-    SET_NO_MODE(CSI_MODE);
-    SET_NO_MODE(ESC_MODE);
-
-    return FALSE;
+    terminal_damage_cells(terminal, terminal->cursor.y, x, right);
 }
 
-int handle_esc_codes(Terminal* terminal, unsigned char control_code){
-    if (!IS_MODE(ESC_MODE)){
-        return FALSE;
-    }
+/*
+ * Writes a character at the cursor and moves the cursor past it. A wide
+ * character takes the next cell as well, which holds a spacer, and goes
+ * to the next row rather than being cut at the last column. A combining
+ * character goes on the character before it and takes no cell, it is
+ * dropped if there is none.
+ */
+static int terminal_put_char(Terminal* terminal, unsigned int character_code){
+    TElement* line;
+    int width;
+    int x;
+    int ret;
 
-    // handle charset sequences (dont leave esc mode).
-    if ((control_code == '(') ||
-        (control_code == ')') ||
-        (control_code == '%')){
-        if (esc_code_handlers[control_code]){
-            (esc_code_handlers[control_code])(terminal);
-            return TRUE;
+    if (character_code >= 0x300){
+        x = terminal_joins(terminal, character_code);
+        if (x >= 0){
+            terminal_join_cell(terminal, x, character_code);
+            return 0;
         }
-        LOG("no esc handler found for: %u (charset sequence).\n", control_code);
     }
 
-    if (esc_code_handlers[control_code]){
-        (esc_code_handlers[control_code])(terminal);
+    width = unicode_width(character_code);
+    if (width == 0){
+        return 0;
+    }
+    if (terminal->cols_number < 2){
+        width = 1;
+    }
 
-        SET_NO_MODE(ESC_G0_MODE);
-        SET_NO_MODE(ESC_G1_MODE);
-        SET_NO_MODE(ESC_CHARSET_MODE);
-        SET_NO_MODE(ESC_MODE);
-        return TRUE;
+    if (terminal->wrap_pending && IS_VT_MODE(VT_DECAWM_MODE)){
+        ret = terminal_wrap(terminal);
+        ASSERT(ret == 0, "failed to wrap.\n");
     }
+    terminal->wrap_pending = FALSE;
 
-    LOG("no esc handler found for: %u\n", control_code);
-    return TRUE;
-}
+    if (width == 2 && terminal->cursor.x == terminal->cols_number - 1){
+        if (IS_VT_MODE(VT_DECAWM_MODE)){
+            line = terminal_line_write(terminal, terminal->cursor.y);
+            ASSERT(line, "failed to write line.\n");
 
-int handle_control_codes(Terminal* terminal, unsigned char control_code){
-	/* 
-     * FROM ST:
-     * 
-	 * STR sequence must be checked before anything else
-	 * because it uses all following characters until it
-	 * receives a ESC, a SUB, a ST or any other C1 control
-	 * character.
-	 */
-    if (handle_osc_codes(terminal, control_code)){
-        return TRUE;
-    }
+            terminal_split_wide(terminal, terminal->cursor.y, terminal->cursor.x, terminal->cursor.x);
+            line[terminal->cursor.x].character_code = BLANK_ELEMENT;
+            line[terminal->cursor.x].style = terminal->style;
+            line[terminal->cursor.x].flags = ELEMENT_PAD;
+            terminal_damage_cells(terminal, terminal->cursor.y, terminal->cursor.x, terminal->cursor.x);
 
-    if (handle_csi_codes(terminal, control_code)){
-        return TRUE;
+            ret = terminal_wrap(terminal);
+            ASSERT(ret == 0, "failed to wrap.\n");
+        }else{
+            terminal->cursor.x--;
+        }
     }
 
-    if (handle_esc_codes(terminal, control_code)){
-        return TRUE;
+    x = terminal->cursor.x;
+    line = terminal_line_write(terminal, terminal->cursor.y);
+    ASSERT(line, "failed to write line.\n");
+    terminal_split_wide(terminal, terminal->cursor.y, x, x + width - 1);
+
+    // a character written over itself is not damaged.
+    if (line[x].character_code != character_code || line[x].style != terminal->style || line[x].flags != 0 ||
+        (width == 2 && (line[x + 1].character_code != ELEMENT_SPACER || line[x + 1].style != terminal->style ||
+                        line[x + 1].flags != 0))){
+        line[x].character_code = character_code;
+        line[x].style = terminal->style;
+        line[x].flags = 0;
+        if (width == 2){
+            line[x + 1].character_code = ELEMENT_SPACER;
+            line[x + 1].style = terminal->style;
+            line[x + 1].flags = 0;
+        }
+        terminal_damage_cells(terminal, terminal->cursor.y, x, x + width - 1);
     }
 
-    if (control_code_handlers[control_code]){
-        (control_code_handlers[control_code])(terminal);
-        return TRUE;
+    if (x + width < terminal->cols_number){
+        terminal->cursor.x = x + width;
+    }else{
+        terminal->cursor.x = terminal->cols_number - 1;
+        if (IS_VT_MODE(VT_DECAWM_MODE)){
+            terminal->wrap_pending = TRUE;
+        }
     }
+    return 0;
 
-    return FALSE;
+fail:
+    return -1;
 }
 
-// ----------------------------------------------------------------------
-
-/*
- * This it the main function of the terminal. it gets 
- * character_code as input and handle control code if they appear.
- */
-
-int terminal_emulate(Terminal* terminal, unsigned int character_code){
+void print_action(Terminal* terminal, unsigned int character_code){
     int ret;
 
-    // can be control character only if 1 byte.
-    if (BETWEEN(character_code, 0, 0xFF)){
-        unsigned char control_code = character_code & 0xFF;
-        ret = handle_control_codes(terminal, control_code);
-        if (ret == TRUE){
-            return 0;
-        }
-    }
-
     /*
      * The table is proudly stolen from st which stole from rxvt.
      */
@@ -1870,55 +2657,880 @@ int terminal_emulate(Terminal* terminal, unsigned int character_code){
     if ((IS_CHARSET(CHARSET_G0_SPECIAL)) &&
             (BETWEEN(character_code, 0x41, 0x7E)) &&
             (vt100_0[character_code - 0x41])){
-        character_code = *vt100_0[character_code - 0x41];
+        // the glyphs are utf8, not a single byte.
+        char* glyph = vt100_0[character_code - 0x41];
+        TUtf8Decoder decoder = { UTF8_ACCEPT, 0 };
+
+        utf8_decode_buffer(&decoder, (unsigned char*) glyph, strlen(glyph), &character_code);
+    }
+
+    LOG_TRACE("Putting char: '%c' (%d, %d)\n", character_code, terminal->cursor.x, terminal->cursor.y);
+
+    ret = terminal_put_char(terminal, character_code);
+    ASSERT(ret == 0, "failed to put char.\n");
+
+fail:
+    return;
+}
+
+void execute_action(Terminal* terminal, unsigned int character_code){
+    void (*handler)(Terminal* terminal) = NULL;
+
+    if (character_code < 0x80){
+        handler = control_code_handlers[character_code];
+    }else{
+        // C1 control is the same as ESC (character_code - 0x40).
+        handler = esc_code_handlers[character_code - 0x40];
+    }
+
+    if (handler){
+        handler(terminal);
+    }
+}
+
+void collect_action(Terminal* terminal, unsigned int character_code){
+    // private markers only come first, right after the CSI/DCS.
+    if (BETWEEN(character_code, 0x3C, 0x3F)){
+        terminal->private_marker = character_code;
+        return;
+    }
+
+    if (terminal->intermediates_index == ESC_MAX_INTERMEDIATES){
+        LOG_DEBUG("too much intermediate characters.\n");
+        return;
+    }
+    terminal->intermediates[terminal->intermediates_index] = character_code;
+    terminal->intermediates_index++;
+}
+
+/*
+ * Parameters are accumulated as integers while they arrive,
+ * parameters beyond CSI_MAX_PARAMETERS are ignored and values 
+ * are clamped to CSI_MAX_PARAMETER_VALUE.
+ */
+void param_action(Terminal* terminal, unsigned int character_code){
+    int index = terminal->csi_parameters_index;
+
+    if (index < 0){
+        index = 0;
+        terminal->csi_parameters[0] = 0;
+        terminal->csi_parameters_index = 0;
     }
 
-    LOG("Putting char: '%c' (%d, %d)\n", character_code, terminal->cursor.x, terminal->cursor.y);
+    if (BETWEEN(character_code, '0', '9')){
+        if (index < CSI_MAX_PARAMETERS){
+            int value = (terminal->csi_parameters[index] * 10) + (character_code - '0');
+
+            if (value > CSI_MAX_PARAMETER_VALUE){
+                value = CSI_MAX_PARAMETER_VALUE;
+            }
+            terminal->csi_parameters[index] = value;
+        }
+        return;
+    }
+
+    // ';' or ':' starts the next parameter.
+    index++;
+    terminal->csi_parameters_index = index;
+
+    if (index < CSI_MAX_PARAMETERS){
+        terminal->csi_parameters[index] = 0;
+
+        if (character_code == ':'){
+            terminal->csi_subparameters |= (1u << index);
+        }
+    }
+}
+
+void esc_dispatch_action(Terminal* terminal, unsigned int character_code){
+    void (**handlers)(Terminal* terminal) = esc_code_handlers;
+
+    if (IS_INTERMEDIATE('(') || IS_INTERMEDIATE(')')){
+        handlers = esc_charset_handlers;
+    }else if (IS_INTERMEDIATE('%')){
+        handlers = esc_select_charset_handlers;
+    }else if (terminal->intermediates_index > 0){
+        LOG_DEBUG("no esc handler found for: %u (intermediate: %u).\n", 
+                  character_code, 
+                  terminal->intermediates[0]);
+        return;
+    }
+
+    if (handlers[character_code]){
+        (handlers[character_code])(terminal);
+        return;
+    }
+
+    LOG_DEBUG("no esc handler found for: %u\n", character_code);
+}
+
+void csi_dispatch_action(Terminal* terminal, unsigned int character_code){
+    if (csi_code_handlers[character_code]){
+        (csi_code_handlers[character_code])(terminal);
+    }else{
+        int len;
+        int* parameters = csi_get_parameters(terminal, &len);
+
+        LOG_DEBUG("csi handler wasn't found for: %d\n", character_code);
+        csi_log_parameters(parameters, len);
+    }
+}
+
+void put_action(Terminal* terminal, unsigned int character_code){
+    // no device control string is supported (yet).
+}
+
+void osc_put_action(Terminal* terminal, unsigned int character_code){
+    char encoded[UTF8_MAX_BYTES];
+    int len;
+
+    len = utf8_encode(character_code, encoded);
+
+    ASSERT((terminal->osc_buffer_index + len < OSC_MAX_CHARS), 
+            "osc -> number of string exceeded limit.\n");
+
+    memcpy(&terminal->osc_buffer[terminal->osc_buffer_index], encoded, len);
+    terminal->osc_buffer_index += len;
+
+fail:
+    return;
+}
+
+void (*parser_action_handlers[ACTIONS_NUMBER])(Terminal* terminal, unsigned int character_code) = {
+    [ACTION_IGNORE] = ignore_action,
+    [ACTION_PRINT] = print_action,
+    [ACTION_EXECUTE] = execute_action,
+    [ACTION_COLLECT] = collect_action,
+    [ACTION_PARAM] = param_action,
+    [ACTION_ESC_DISPATCH] = esc_dispatch_action,
+    [ACTION_CSI_DISPATCH] = csi_dispatch_action,
+    [ACTION_PUT] = put_action,
+    [ACTION_OSC_PUT] = osc_put_action
+};
+
+// ----------------------------------------------------------------------
+
+// ----------------------------------------------------------------------
+// Parser states entry and exit actions
+// ----------------------------------------------------------------------
+
+void clear_action(Terminal* terminal){
+    terminal->csi_parameters_index = -1;
+    terminal->csi_subparameters = 0;
+
+    memset(terminal->intermediates, 0, sizeof(terminal->intermediates));
+    terminal->intermediates_index = 0;
+    terminal->private_marker = 0;
+}
+
+void osc_start_action(Terminal* terminal){
+    memset(terminal->osc_buffer, 0, sizeof(terminal->osc_buffer));
+    terminal->osc_buffer_index = 0;
+}
+
+void osc_end_action(Terminal* terminal){
+    LOG_DEBUG("osc -> string: \"%s\".\n", terminal->osc_buffer);
+
+    // TODO: handle osc commands
+}
+
+void hook_action(Terminal* terminal){
+    clear_action(terminal);
+}
+
+void unhook_action(Terminal* terminal){
+}
+
+void (*state_entry_handlers[STATES_NUMBER])(Terminal* terminal) = {
+    [STATE_ESCAPE] = clear_action,
+    [STATE_CSI_ENTRY] = clear_action,
+    [STATE_DCS_ENTRY] = clear_action,
+    [STATE_OSC_STRING] = osc_start_action,
+    [STATE_DCS_PASSTHROUGH] = hook_action
+};
+
+void (*state_exit_handlers[STATES_NUMBER])(Terminal* terminal) = {
+    [STATE_OSC_STRING] = osc_end_action,
+    [STATE_DCS_PASSTHROUGH] = unhook_action
+};
+
+// ----------------------------------------------------------------------
+
+/*
+ * This it the main function of the terminal. it gets 
+ * character_code as input and advances the parser state machine,
+ * printing it or handling it as part of a control sequence.
+ */
+
+int terminal_emulate(Terminal* terminal, unsigned int character_code){
+    unsigned char transition;
+    unsigned int next_state;
+
+    transition = vt_transitions[terminal->state][PARSER_COLUMN(character_code)];
+    next_state = TRANSITION_STATE(transition);
+
+    if (next_state == STATE_NONE){
+        (parser_action_handlers[TRANSITION_ACTION(transition)])(terminal, character_code);
+        return 0;
+    }
+
+    if (state_exit_handlers[terminal->state]){
+        (state_exit_handlers[terminal->state])(terminal);
+    }
+
+    (parser_action_handlers[TRANSITION_ACTION(transition)])(terminal, character_code);
+
+    terminal->state = next_state;
+    if (state_entry_handlers[next_state]){
+        (state_entry_handlers[next_state])(terminal);
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the number of leading codepoints which are printable (not 
+ * C0, DEL or C1 controls), those can be written to the screen as is 
+ * without going through the parser.
+ */
+static int printable_run_length(unsigned int* codepoints, int len){
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i below = _mm_set1_epi32(0x1F);
+    const __m128i del = _mm_set1_epi32(0x7F);
+    const __m128i c1_end = _mm_set1_epi32(0xA0);
+
+    for (; i + 4 <= len; i += 4){
+        __m128i chunk = _mm_loadu_si128((__m128i*) &codepoints[i]);
+
+        // codepoints are at most 0x10FFFF so signed compares are fine.
+        __m128i controls = _mm_or_si128(_mm_cmpeq_epi32(chunk, del),
+                                        _mm_and_si128(_mm_cmpgt_epi32(chunk, del),
+                                                      _mm_cmplt_epi32(chunk, c1_end)));
+        __m128i printable = _mm_andnot_si128(controls, _mm_cmpgt_epi32(chunk, below));
+
+        unsigned int mask = _mm_movemask_epi8(printable);
+        if (mask != 0xFFFF){
+            return i + (__builtin_ctz(~mask) / 4);
+        }
+    }
+#endif
+
+    for (; i < len; i++){
+        unsigned int codepoint = codepoints[i];
+
+        if ((codepoint < 0x20) || BETWEEN(codepoint, 0x7F, 0x9F)){
+            break;
+        }
+    }
+    return i;
+}
+
+// the number of leading bytes which are printable ascii, a cell each.
+static int plain_run_length(char* buf, int len){
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i below = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+
+    for (; i + 16 <= len; i += 16){
+        __m128i chunk = _mm_loadu_si128((__m128i*) &buf[i]);
+
+        // the bytes from 0x80 on are negative, so below 0x20 as well.
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(chunk, below),
+                                                            _mm_cmplt_epi8(chunk, del)));
+        if (mask != 0xFFFF){
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+
+    for (; i < len && BETWEEN((unsigned char) buf[i], 0x20, 0x7E); i++);
+    return i;
+}
+
+/*
+ * Writes a run of printable characters at the cursor position,
+ * same as calling terminal_emulate() for each one of them but with a 
+ * single cursor update for every row. A character which goes on the
+ * one before it, a regional indicator or a wide character which does
+ * not fit in the row is put on its own.
+ */
+static int terminal_put_run(Terminal* terminal, unsigned int* run, int len){
+    TElement* line;
+    unsigned short style = terminal->style;
+    int x, width;
+    int first, last;
+    int split;
+    int ret;
+    int i;
+
+    while (len > 0){
+        // a pictograph after a ZWJ goes on the cell before it, even
+        // when the wrap is pending.
+        if (run[0] >= 0x300 && terminal_joins(terminal, run[0]) >= 0){
+            ret = terminal_put_char(terminal, run[0]);
+            ASSERT(ret == 0, "failed to put char.\n");
+
+            run++;
+            len--;
+            continue;
+        }
+
+        if (terminal->wrap_pending && IS_VT_MODE(VT_DECAWM_MODE)){
+            ret = terminal_wrap(terminal);
+            ASSERT(ret == 0, "failed to wrap.\n");
+        }
+        terminal->wrap_pending = FALSE;
+
+        line = terminal_line_write(terminal, terminal->cursor.y);
+        ASSERT(line, "failed to write line.\n");
+        x = terminal->cursor.x;
+
+        // the run may start on the right half of a wide character.
+        split = x > 0 && line[x].character_code == ELEMENT_SPACER;
+
+        // only the cells which change are damaged, an application
+        // redrawing what is already there damages nothing.
+        first = -1;
+        last = -1;
+        for (i = 0; i < len && x < terminal->cols_number; i++){
+            // everything below the first combining mark takes a single cell.
+            width = run[i] < 0x300 ? 1 : unicode_width(run[i]);
+
+            if (width == 1){
+                if (line[x].character_code == run[i] && line[x].style == style && line[x].flags == 0){
+                    x++;
+
+                    // and so is likely the rest of the run.
+                    while (i + 5 <= len && x + 4 <= terminal->cols_number && 
+                           terminal_same_cells(&line[x], &run[i + 1], style)){
+                        i += 4;
+                        x += 4;
+                    }
+                    continue;
+                }
+                line[x].character_code = run[i];
+                line[x].style = style;
+                line[x].flags = 0;
+                if (first < 0){
+                    first = x;
+                }
+                last = x;
+                x++;
+                continue;
+            }
+            if (width == 0 || x + 1 == terminal->cols_number || UNICODE_IS_REGIONAL(run[i])){
+                break;
+            }
+            if (line[x].character_code != run[i] || line[x].style != style || line[x].flags != 0 ||
+                line[x + 1].character_code != ELEMENT_SPACER || line[x + 1].style != style || line[x + 1].flags != 0){
+                line[x].character_code = run[i];
+                line[x].style = style;
+                line[x].flags = 0;
+                line[x + 1].character_code = ELEMENT_SPACER;
+                line[x + 1].style = style;
+                line[x + 1].flags = 0;
+                if (first < 0){
+                    first = x;
+                }
+                last = x + 1;
+            }
+            x += 2;
+        }
+
+        if (i == 0){
+            ret = terminal_put_char(terminal, run[0]);
+            ASSERT(ret == 0, "failed to put char.\n");
+
+            run++;
+            len--;
+            continue;
+        }
+
+        if (split){
+            line[terminal->cursor.x - 1].character_code = BLANK_ELEMENT;
+            terminal_damage_cells(terminal, terminal->cursor.y, terminal->cursor.x - 1, terminal->cursor.x - 1);
+        }
 
-    // not a control code:
-    // insert simple element to the terminal and moving
-    // cursor forward.
-    ELEMENT.character_code = character_code;
-    ELEMENT.foreground_color = terminal->foreground_color;
-    ELEMENT.background_color = terminal->background_color;
-    ELEMENT.attributes = terminal->attributes;
-    ELEMENT.dirty = 1;
+        // the right half of a wide character overwritten by the run.
+        if (x < terminal->cols_number && line[x].character_code == ELEMENT_SPACER){
+            line[x].character_code = BLANK_ELEMENT;
+            last = x;
+        }
+        if (last >= 0){
+            terminal_damage_cells(terminal, terminal->cursor.y, first < 0 ? x : first, last);
+        }
 
-    ret = terminal_forward_cursor(terminal);
-    ASSERT(ret == 0, "failed to move cursor forward.\n");
+        run += i;
+        len -= i;
 
+        if (x < terminal->cols_number){
+            terminal->cursor.x = x;
+        }else if (IS_VT_MODE(VT_DECAWM_MODE)){
+            terminal->cursor.x = terminal->cols_number - 1;
+            terminal->wrap_pending = TRUE;
+        }else{
+            terminal->cursor.x = terminal->cols_number - 1;
+
+            // without auto wrap everything beyond the last column is
+            // written over the last column, so only the last character
+            // is, if it takes a single cell.
+            if (len > 0 && unicode_width(run[len - 1]) == 1){
+                terminal_split_wide(terminal, terminal->cursor.y, terminal->cursor.x, terminal->cursor.x);
+                line[terminal->cursor.x].character_code = run[len - 1];
+                line[terminal->cursor.x].style = style;
+                line[terminal->cursor.x].flags = 0;
+                terminal_damage_cells(terminal, terminal->cursor.y, terminal->cursor.x, terminal->cursor.x);
+                break;
+            }
+        }
+    }
     return 0;
 
 fail:
     return -1;
 }
 
-int terminal_push(Terminal* terminal, char* buf, int len){
+// ----------------------------------------------------------------------
+// Fast sequences.
+//
+// Most of the escapes of real traffic are a few sequences: the SGR
+// reset, the truecolor SGR, CUP and EL. Those are matched right in the
+// decoded input and applied at once, rather than going through the
+// parser a codepoint at a time. Anything else, or a sequence cut by the
+// end of the input, is left to the parser.
+// ----------------------------------------------------------------------
+
+#define FAST_PARAMETERS_MAX (10) // two truecolors.
+
+// a truecolor component, 0 to 255.
+#define FAST_COLOR(x) ((unsigned int) (x) <= 0xFF)
+
+/*
+ * Reads the parameters of the CSI sequence after ESC [ at codepoints,
+ * digits only and none empty. Returns the index of the final byte, 0 if
+ * the sequence is cut or does not have that form.
+ */
+static inline int fast_parameters(unsigned int* codepoints, int len, int* parameters, int* parameters_number){
+    int i = 2;
+    int start;
+    int n = 0;
+
+    if (i < len && !BETWEEN(codepoints[i], '0', '9')){
+        *parameters_number = 0;
+        return i;
+    }
+
+    while (n < FAST_PARAMETERS_MAX){
+        // at most 5 digits, the parser clamps longer ones.
+        parameters[n] = 0;
+        for (start = i; i < len && BETWEEN(codepoints[i], '0', '9') && i - start < 5; i++){
+            parameters[n] = (parameters[n] * 10) + (codepoints[i] - '0');
+        }
+        if (i == start || i == len){
+            return 0;
+        }
+        n++;
+
+        if (codepoints[i] != ';'){
+            *parameters_number = n;
+            return i;
+        }
+        i++;
+    }
+    return 0;
+}
+
+// SGR of resets and truecolors only, FALSE if it has anything else.
+static int terminal_fast_sgr(Terminal* terminal, int* parameters, int parameters_number){
+    unsigned int foreground_color = terminal->foreground_color;
+    unsigned int background_color = terminal->background_color;
+    unsigned int attributes = terminal->attributes;
+    int i = 0;
+
+    if (parameters_number == 0){
+        parameters[0] = 0;
+        parameters_number = 1;
+    }
+
+    while (i < parameters_number){
+        if (parameters[i] == 0){
+            attributes = 0;
+            foreground_color = terminal->default_foreground_color;
+            background_color = terminal->default_background_color;
+            i++;
+            continue;
+        }
+
+        if ((parameters[i] != 38 && parameters[i] != 48) ||
+            i + 5 > parameters_number ||
+            parameters[i + 1] != 2 ||
+            !FAST_COLOR(parameters[i + 2]) ||
+            !FAST_COLOR(parameters[i + 3]) ||
+            !FAST_COLOR(parameters[i + 4])){
+            return FALSE;
+        }
+        if (parameters[i] == 38){
+            foreground_color = TRUE_COLOR_COLOR(parameters[i + 2], parameters[i + 3], parameters[i + 4]);
+        }else{
+            background_color = TRUE_COLOR_COLOR(parameters[i + 2], parameters[i + 3], parameters[i + 4]);
+        }
+        i += 5;
+    }
+
+    terminal->attributes = attributes;
+    terminal->foreground_color = foreground_color;
+    terminal->background_color = background_color;
+    terminal_update_style(terminal);
+    return TRUE;
+}
+
+/*
+ * Applies the sequence at codepoints, which starts with ESC, if it is
+ * one of the fast ones. Returns the codepoints it takes, 0 if it is not
+ * one of them and is left to the parser.
+ */
+static int terminal_fast_sequence(Terminal* terminal, unsigned int* codepoints, int len){
+    int parameters[FAST_PARAMETERS_MAX];
+    int parameters_number;
+    int end;
+    int ret;
+
+    if (len < 3 || codepoints[1] != '['){
+        return 0;
+    }
+    end = fast_parameters(codepoints, len, parameters, &parameters_number);
+    if (end == 0){
+        return 0;
+    }
+
+    switch (codepoints[end]){
+        case 'm':
+            if (!terminal_fast_sgr(terminal, parameters, parameters_number)){
+                return 0;
+            }
+            break;
+
+        // CUP of a row and a column on the screen.
+        case 'H':
+            if (parameters_number != 2 ||
+                !BETWEEN(parameters[0], 1, terminal->rows_number) ||
+                !BETWEEN(parameters[1], 1, terminal->cols_number)){
+                return 0;
+            }
+            terminal->cursor.y = parameters[0] - 1;
+            terminal->cursor.x = parameters[1] - 1;
+            terminal->wrap_pending = FALSE;
+            break;
+
+        // EL to the end of the line.
+        case 'K':
+            if (parameters_number > 1 || (parameters_number == 1 && parameters[0] != 0)){
+                return 0;
+            }
+            ret = terminal_erase_cells(terminal,
+                                       terminal->cursor.y,
+                                       terminal->cursor.x,
+                                       terminal->cols_number - 1);
+            ASSERT(ret == 0, "failed to erase cells.\n");
+            break;
+
+        default:
+            return 0;
+    }
+    return end + 1;
+
+fail:
+    return end + 1;
+}
+
+// ----------------------------------------------------------------------
+// Fast forward.
+//
+// A burst of plain lines, printable ascii ended by CR LF as `cat` of a
+// log writes them, may scroll the whole screen off many times before
+// it can be drawn. The lines which would only pass through the screen
+// are cut into rows and pushed to the scrollback as the screen would
+// have pushed them, nothing is written to the screen nor damaged.
+// ----------------------------------------------------------------------
+
+// the cursor is at the bottom of the whole primary screen, and every
+// plain byte is printed as is.
+static inline int terminal_can_fast_forward(Terminal* terminal){
+    return !terminal->alternate &&
+           terminal->top == 0 &&
+           terminal->bottom == terminal->rows_number - 1 &&
+           terminal->cursor.y == terminal->bottom &&
+           terminal->state == STATE_GROUND &&
+           terminal->utf8_decoder.state == UTF8_ACCEPT &&
+           !IS_CHARSET(CHARSET_G0_SPECIAL) &&
+           IS_VT_MODE(VT_DECAWM_MODE);
+}
+
+// the cursor starts a blank row, as a new line leaves it.
+static inline int terminal_at_line_start(Terminal* terminal){
+    int index = terminal_line_index(terminal, terminal->cursor.y);
+
+    return terminal->cursor.x == 0 &&
+           !terminal->wrap_pending &&
+           terminal->lines_flags[index] == 0 &&
+           terminal_blank_index(terminal, index);
+}
+
+// pushes the rows a plain line of length bytes takes to the scrollback.
+static int terminal_save_plain_line(Terminal* terminal, char* text, int length){
+    TElement* cells;
+    int wrapped;
+    int used;
     int ret;
     int i;
 
-    unsigned int utf8_state = UTF8_ACCEPT;
-    unsigned int utf8_codepoint;
+    do{
+        wrapped = length > terminal->cols_number;
+        used = wrapped ? terminal->cols_number : length;
+
+        // the trailing blanks of the last row are trimmed as
+        // terminal_line_length() does.
+        length -= used;
+        if (!wrapped && terminal->style == STYLE_DEFAULT){
+            while (used > 0 && text[used - 1] == BLANK_ELEMENT){
+                used--;
+            }
+        }
 
-    for (i = 0; i < len; i++){
-        char curr = buf[i];
+        cells = NULL;
+        if (used > 0){
+            cells = (TElement*) malloc(sizeof(TElement) * used);
+            ASSERT(cells, "failed to malloc scrollback line.\n");
 
-        // unicode 
-        if (!utf8_decode(&utf8_state, 
-                         &utf8_codepoint, 
-                         (unsigned char) curr)){
+            for (i = 0; i < used; i++){
+                cells[i].character_code = (unsigned char) text[i];
+                cells[i].style = terminal->style;
+                cells[i].flags = 0;
+            }
+        }
 
-            ret = terminal_emulate(terminal, utf8_codepoint);
-            ASSERT(ret == 0, "failed in emulate.\n");
+        ret = scrollback_push(terminal->scrollback, cells, used, wrapped);
+        ASSERT((ret == 0), "failed to push line to scrollback.\n");
+
+        text += terminal->cols_number;
+    }while (length > 0);
+
+    return 0;
+
+fail:
+    return -1;
+}
 
-            utf8_codepoint = 0;
+/*
+ * Takes the burst of plain lines at the start of buf, the cursor is at
+ * the start of a line (see terminal_at_line_start()). The screen scrolls
+ * off first and every line goes to the scrollback but the last ones,
+ * which fill the screen from its top up to the cursor row: that is
+ * where the slow path would have scrolled them to, so they are left to
+ * it and the screen ends the same. Returns the bytes taken, 0 if the
+ * burst does not fill the screen twice, end is set past the burst.
+ */
+static int terminal_fast_forward(Terminal* terminal, char* buf, int len, char** end){
+    char* line = buf;
+    int rows_number = 0;
+    int length;
+    int rows;
+    int ret;
+    int y;
+
+    // the rows of the whole burst.
+    while (TRUE){
+        length = plain_run_length(line, (buf + len) - line);
+        if (length + 2 > (buf + len) - line || line[length] != '\r' || line[length + 1] != '\n'){
+            break;
         }
-        
-        if (utf8_state == UTF8_REJECT){
-            LOG("utf8 code mallformed\n");
+        rows_number += SCROLLBACK_VIEW_ROWS(length, terminal->cols_number);
+        line += length + 2;
+    }
+    *end = line;
 
-            utf8_state = UTF8_ACCEPT;
-            utf8_codepoint = 0;
+    if (rows_number < (2 * terminal->rows_number) - 1){
+        return 0;
+    }
+
+    // the rows above the cursor, the cursor row is blank and is the
+    // first row of the burst.
+    ret = terminal_save_lines(terminal, terminal->rows_number - 1);
+    ASSERT(ret == 0, "failed to save lines.\n");
+    for (y = 0; y < terminal->rows_number - 1; y++){
+        terminal_empty_line(terminal, y);
+    }
+
+    for (line = buf; ; line += length + 2){
+        length = (char*) memchr(line, '\n', *end - line) - line - 1;
+        rows = SCROLLBACK_VIEW_ROWS(length, terminal->cols_number);
+        if (rows_number - rows < terminal->rows_number - 1){
+            break;
+        }
+        rows_number -= rows;
+
+        ret = terminal_save_plain_line(terminal, line, length);
+        ASSERT(ret == 0, "failed to save plain line.\n");
+    }
+
+    terminal->cursor.y = 0;
+    return line - buf;
+
+fail:
+    return -1;
+}
+
+void terminal_collect_styles(Terminal* terminal){
+    TElement* line;
+    int x, y;
+
+    // the cells of the blank rows are not used.
+    for (y = 0; y < terminal->rows_number; y++){
+        line = terminal_line(terminal, y);
+        for (x = 0; x < terminal->cols_number; x++){
+            style_mark(terminal->styles, line[x].style);
+        }
+
+        line = terminal_other_line(terminal, y);
+        for (x = 0; x < terminal->cols_number; x++){
+            style_mark(terminal->styles, line[x].style);
+        }
+    }
+    scrollback_mark_styles(terminal->scrollback, terminal->styles);
+    style_mark(terminal->styles, terminal->style);
+
+    style_sweep(terminal->styles);
+}
+
+void terminal_collect_clusters(Terminal* terminal){
+    TElement* line;
+    int x, y;
+
+    for (y = 0; y < terminal->rows_number; y++){
+        line = terminal_line(terminal, y);
+        for (x = 0; x < terminal->cols_number; x++){
+            if (line[x].character_code & ELEMENT_CLUSTER){
+                cluster_mark(terminal->clusters, line[x].character_code & ~ELEMENT_CLUSTER);
+            }
+        }
+
+        line = terminal_other_line(terminal, y);
+        for (x = 0; x < terminal->cols_number; x++){
+            if (line[x].character_code & ELEMENT_CLUSTER){
+                cluster_mark(terminal->clusters, line[x].character_code & ~ELEMENT_CLUSTER);
+            }
+        }
+    }
+    scrollback_mark_clusters(terminal->scrollback, terminal->clusters);
+
+    cluster_sweep(terminal->clusters);
+}
+
+int terminal_update_style(Terminal* terminal){
+    TStyle style = {
+        .attributes = terminal->attributes,
+        .foreground_color = terminal->foreground_color,
+        .background_color = terminal->background_color
+    };
+    int id;
+
+    id = style_intern(terminal->styles, &style);
+    if (id < 0){
+        // make room, and grow when most of the styles are still used
+        // so the next collection is not right around the corner.
+        terminal_collect_styles(terminal);
+        if (terminal->styles->styles_number > terminal->styles->capacity / 2){
+            if (terminal->styles->capacity < STYLES_MAX){
+                style_table_grow(terminal->styles);
+            }else if (scrollback_pack_lines(terminal->scrollback) == 0){
+                // at the maximum size the newest lines of the scrollback
+                // are packed early, their styles then no longer use ids.
+                terminal_collect_styles(terminal);
+            }
+        }
+
+        id = style_intern(terminal->styles, &style);
+        ASSERT((id >= 0), "style table is full.\n");
+    }
+
+    terminal->style = id;
+    return 0;
+
+fail:
+    terminal->style = STYLE_DEFAULT;
+    return -1;
+}
+
+int terminal_push(Terminal* terminal, char* buf, int len){
+    unsigned int codepoints[TERMINAL_DECODE_CHUNK];
+    char* burst_end = buf; // the last burst found, too short to fast forward.
+    int ret;
+    int i;
+
+    while (len > 0){
+        int chunk = len < LENGTH(codepoints) ? len : LENGTH(codepoints);
+        int count;
+
+        // a burst is looked for at the start of every line once the
+        // cursor is at the bottom, the chunk stops at the end of the line.
+        if (buf >= burst_end && terminal_can_fast_forward(terminal)){
+            if (terminal_at_line_start(terminal)){
+                ret = terminal_fast_forward(terminal, buf, len, &burst_end);
+                ASSERT((ret >= 0), "failed to fast forward.\n");
+
+                buf += ret;
+                len -= ret;
+                if (ret > 0){
+                    continue;
+                }
+            }else{
+                char* line_end = (char*) memchr(buf, '\n', chunk);
+
+                if (line_end){
+                    chunk = (line_end - buf) + 1;
+                }
+            }
+        }
+
+        count = utf8_decode_buffer(&terminal->utf8_decoder,
+                                   (unsigned char*) buf, 
+                                   chunk, 
+                                   codepoints);
+        buf += chunk;
+        len -= chunk;
+
+        for (i = 0; i < count; i++){
+            // fast path: runs of printable characters while not inside 
+            // any escape sequence are written to the screen at once.
+            if ((terminal->state == STATE_GROUND) &&
+                !IS_CHARSET(CHARSET_G0_SPECIAL)){
+                int run = printable_run_length(&codepoints[i], count - i);
+
+                if (run > 0){
+                    ret = terminal_put_run(terminal, &codepoints[i], run);
+                    ASSERT(ret == 0, "failed to put printable run.\n");
+
+                    i += run - 1;
+                    continue;
+                }
+            }
+
+            // and so are the most common sequences.
+            if ((codepoints[i] == 0x1B) && (terminal->state == STATE_GROUND)){
+                int taken = terminal_fast_sequence(terminal, &codepoints[i], count - i);
+
+                if (taken > 0){
+                    i += taken - 1;
+                    continue;
+                }
+            }
+
+            ret = terminal_emulate(terminal, codepoints[i]);
+            ASSERT(ret == 0, "failed in emulate.\n");
         }
     }
     return 0;
@@ -1930,9 +3542,49 @@ fail:
 TElement* terminal_element(Terminal* terminal, int x, int y){
     TElement* element = NULL;
 
-    element = &terminal->screen[(y * terminal->cols_number) + x];
+    element = &terminal_line(terminal, y)[x];
 
     return element;
 }
 
+int terminal_damage(Terminal* terminal, int y, int* left, int* right){
+    *left = terminal->damage[y].left;
+    *right = terminal->damage[y].right;
+
+    return (terminal->damage_rows[y / DAMAGE_WORD_BITS] & (1U << (y % DAMAGE_WORD_BITS))) != 0;
+}
+
+void terminal_clear_damage(Terminal* terminal, int y){
+    terminal->damage_rows[y / DAMAGE_WORD_BITS] &= ~(1U << (y % DAMAGE_WORD_BITS));
+
+    terminal->damage[y].left = terminal->cols_number;
+    terminal->damage[y].right = -1;
+}
+
+void terminal_mark_damage(Terminal* terminal, int x, int y){
+    terminal_damage_cells(terminal, y, x, x);
+}
+
+int terminal_next_damage(Terminal* terminal, int y){
+    int words = DAMAGE_WORDS(terminal->rows_number);
+    int word = y / DAMAGE_WORD_BITS;
+    unsigned int bits;
+
+    if (y >= terminal->rows_number){
+        return -1;
+    }
 
+    bits = terminal->damage_rows[word] & (~0U << (y % DAMAGE_WORD_BITS));
+    while (bits == 0){
+        if (++word >= words){
+            return -1;
+        }
+        bits = terminal->damage_rows[word];
+    }
+
+    return (word * DAMAGE_WORD_BITS) + __builtin_ctz(bits);
+}
+
+int terminal_synchronized(Terminal* terminal){
+    return IS_VT_MODE(VT_SYNC_MODE) != 0;
+}
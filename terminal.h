@@ -1,8 +1,18 @@
 #ifndef TERMINAL_H
 #define TERMINAL_H
 
+/*
+ * The emulation core, built into libterminal.a without any X11 
+ * dependency. A terminal created without a pty (NULL) only parses,
+ * replies to the application (e.g. DSR) are dropped.
+ */
+
 #include "element.h"
 #include "pty.h"
+#include "utf8.h"
+#include "style.h"
+#include "cluster.h"
+#include "scrollback.h"
 
 
 // attributes definitions
@@ -12,23 +22,68 @@
 #define UNDERLINE_ATTR      (1 << 3)
 #define REVERSE_ATTR        (1 << 4)
 
+// flags of a screen row.
+#define ROW_WRAPPED         (1 << 0) // auto wrap went on to the next row.
+
 typedef struct{
     int x;
     int y;
 }TCursor;
 
+// the columns that changed in a row.
+typedef struct{
+    int left;
+    int right;
+}TDamage;
+
 #define OSC_MAX_CHARS (1024 * 4)
-#define CSI_MAX_PARAMETERS_CHARS (16)
+#define CSI_MAX_PARAMETERS (32)
+#define CSI_MAX_PARAMETER_VALUE (0xFFFF)
+#define ESC_MAX_INTERMEDIATES (2)
+#define TERMINAL_DECODE_CHUNK (1024)
 typedef struct{
     int cols_number;
     int rows_number;
 
-    TElement* screen;
+    // ring of the screen rows, the row at the top of the screen is
+    // lines[start_line_index], so scrolling the whole screen only 
+    // moves start_line_index (see terminal_line()).
+    TElement** lines;
+    unsigned char* lines_flags; // ROW_* of every row, indexed like lines.
+    int start_line_index;
+
+    // the erase generation every row was last written in, indexed like
+    // lines. a row of an older generation is blank whatever its cells
+    // hold, so erasing the screen only bumps generation and the cells
+    // are blanked once the row is written again. the rows which have no
+    // cells of their own point to blank_line, which is shared and never
+    // written (see terminal_line_write()).
+    unsigned int* lines_generation;
+    unsigned int generation;
+    TElement* blank_line;
+
+    // the screen which is not shown, primary or alternate, swapped
+    // with the one above by pointer. the alternate screen never adds
+    // to the scrollback.
+    TElement** other_lines;
+    unsigned char* other_lines_flags;
+    unsigned int* other_lines_generation;
+    unsigned int other_generation;
+    int other_start_line_index;
+    int alternate; // TRUE while the alternate screen is shown.
+
+    // damaged rows of the screen, a bit for each row, and the 
+    // span that changed in every one of them.
+    unsigned int* damage_rows;
+    TDamage* damage;
+
     TCursor cursor;
 
-    TCursor saved_cursor;
+    // the last column was written in auto wrap mode, the cursor stays
+    // there and the next printable character wraps.
+    int wrap_pending;
 
-    int start_line_index;
+    TCursor saved_cursor;
 
     int top;
     int bottom;
@@ -36,25 +91,82 @@ typedef struct{
     unsigned int default_background_color;
     unsigned int default_foreground_color;
 
+    TStyleTable* styles;
+    TClusterTable* clusters;
+
+    // the rows that scrolled off the top of the screen.
+    TScrollback* scrollback;
+
     TPty* pty; // the attached pty.
 
     // ---- parameters to keep state of control codes! ----
 
-    unsigned int mode;
+    TUtf8Decoder utf8_decoder; // kept between pushes.
+
+    unsigned int state; // parser state.
     unsigned int vt_mode;
     unsigned int attributes;
     unsigned int charset;
     unsigned int background_color;
     unsigned int foreground_color;
+    unsigned short style; // the interned attributes and colors above.
+
+    unsigned char intermediates[ESC_MAX_INTERMEDIATES + 1];
+    int intermediates_index;
+    unsigned char private_marker;
 
-    unsigned char csi_parameters[CSI_MAX_PARAMETERS_CHARS + 1]; 
-    int csi_parameters_index;
+    int csi_parameters[CSI_MAX_PARAMETERS];
+    int csi_parameters_index; // the current parameter, -1 if none.
+    unsigned int csi_subparameters; // bit for each parameter after ':'.
 
     unsigned char osc_buffer[OSC_MAX_CHARS + 1];
     int osc_buffer_index;
 }Terminal;
 
 
+static inline TStyle* terminal_style(Terminal* terminal, unsigned short id){
+    return &terminal->styles->styles[id];
+}
+
+// the codepoints of the character of a cell.
+static inline int terminal_codes(Terminal* terminal, TElement* element, unsigned int** codes){
+    return cluster_codes(terminal->clusters, &element->character_code, codes);
+}
+
+static inline int terminal_line_index(Terminal* terminal, int y){
+    int index = terminal->start_line_index + y;
+
+    if (index >= terminal->rows_number){
+        index -= terminal->rows_number;
+    }
+    return index;
+}
+
+// row y of the screen, to be read only, a blank row is blank_line.
+static inline TElement* terminal_line(Terminal* terminal, int y){
+    int index = terminal_line_index(terminal, y);
+
+    if (terminal->lines_generation[index] != terminal->generation){
+        return terminal->blank_line;
+    }
+    return terminal->lines[index];
+}
+
+static inline unsigned char* terminal_line_flags(Terminal* terminal, int y){
+    return &terminal->lines_flags[terminal_line_index(terminal, y)];
+}
+
+// row y of the screen which is not shown, to be read only.
+static inline TElement* terminal_other_line(Terminal* terminal, int y){
+    int index = (terminal->other_start_line_index + y) % terminal->rows_number;
+
+    if (terminal->other_lines_generation[index] != terminal->other_generation){
+        return terminal->blank_line;
+    }
+    return terminal->other_lines[index];
+}
+
+
 Terminal* terminal_create(  TPty* pty,
                             int cols_number, 
                             int rows_number, 
@@ -62,6 +174,7 @@ Terminal* terminal_create(  TPty* pty,
                             char* foreground_color);
 void terminal_destroy(Terminal* terminal);
 
+// rewraps the lines of the screen to the new width.
 int terminal_resize(Terminal* terminal, 
                     int cols_number, 
                     int rows_number);
@@ -69,10 +182,17 @@ int terminal_resize(Terminal* terminal,
 int terminal_forward_cursor(Terminal* terminal);
 int terminal_new_line(Terminal* terminal);
 
+// the row to be written, with cells of its own which are blank if it
+// was, NULL if they can't be allocated.
+TElement* terminal_line_write(Terminal* terminal, int y);
+TElement* terminal_other_line_write(Terminal* terminal, int y);
+
+int terminal_erase_cells(Terminal* terminal, int y, int left, int right);
 int terminal_empty_element(Terminal* terminal, int x, int y);
 int terminal_empty_line(Terminal* terminal, int y);
 int terminal_empty(Terminal* terminal);
 
+// insert and delete chars_number cells at left, within [left, right].
 int terminal_scroll_right(Terminal* terminal, int y, int left, int right, int chars_number);
 int terminal_scroll_left(Terminal* terminal, int y, int left, int right, int chars_number);
 int terminal_scrollup(Terminal* terminal, int top_y, int bottom_y, int lines_number);
@@ -81,8 +201,29 @@ int terminal_move_line(Terminal* terminal, int src_y, int dst_y);
 
 int terminal_emulate(Terminal* terminal, unsigned int character_code);
 
+// interns the current attributes and colors as the style of new cells.
+int terminal_update_style(Terminal* terminal);
+void terminal_collect_styles(Terminal* terminal);
+void terminal_collect_clusters(Terminal* terminal);
+
+// a burst of plain lines which would scroll off before it could be drawn
+// goes straight to the scrollback, the screen ends the same.
 int terminal_push(Terminal* terminal, char* buf, int len);
+// to be read only, see terminal_line().
 TElement* terminal_element(Terminal* terminal, int x, int y);
 
+// the span [left, right] of row y changed since its damage was cleared,
+// returns FALSE if nothing in the row changed.
+int terminal_damage(Terminal* terminal, int y, int* left, int* right);
+void terminal_clear_damage(Terminal* terminal, int y);
+void terminal_mark_damage(Terminal* terminal, int x, int y);
+
+// the first damaged row from y on, -1 if there is none.
+int terminal_next_damage(Terminal* terminal, int y);
+
+// the application is drawing a frame (mode 2026), which is not to be
+// drawn until it is done.
+int terminal_synchronized(Terminal* terminal);
+
 
 #endif
@@ -0,0 +1,14 @@
+#!/bin/bash
+# wide characters searched in lines old enough to be packed,
+# run from the top of the tree after make.
+stream=$(mktemp)
+trap 'rm -f $stream' EXIT
+
+for i in $(seq 1 2000); do
+    printf 'line %d 中文 x\r\n' $i
+done > $stream
+
+./tparse -q '中文' $stream | grep -q ' search_matches=2000 ' || {
+    echo "search_packed: missed matches in packed lines"
+    exit 1
+}
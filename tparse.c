@@ -0,0 +1,246 @@
+#include "terminal.h"
+#include "search.h"
+#include "common.h"
+
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+/*
+ * Parse only driver, pushes a recorded stream through the emulator
+ * (no ui and no pty) and reports the throughput as a single line of
+ * key=value pairs, which is what `make bench` collects. The damage is
+ * taken after every burst as the ui would draw it, which reports the
+ * cells a draw redraws on average. The scrollback
+ * is then read back from the oldest line, which reports what a line 
+ * costs in memory and what unpacking it costs. With -f the scrollback
+ * is also appended to a file, and the lines dropped from memory are read
+ * back from it. With -q the screen and the scrollback are then searched
+ * for the text (-e for a regex), which reports the time to the first
+ * match and to the end of the search.
+ *
+ * The stream is pushed in bursts of 64 KiB, the most the ui reads from
+ * the pty before a draw, -b pushes it in smaller ones.
+ *
+ * usage: tparse [-c cols] [-r rows] [-n repeat] [-b burst bytes] [-s scrollback lines]
+ *               [-f scrollback file] [-q text | -e regex] [file]
+ */
+
+#define TPARSE_READ_SIZE (4096)
+#define TPARSE_BURST_SIZE (64 * 1024)
+#define TPARSE_SEARCH_STEP (4096) // lines.
+
+char background_color[] = "#000000";
+char foreground_color[] = "#FFFFFF";
+
+static char* read_file(char* path, int* len){
+    FILE* file = NULL;
+    char* buf = NULL;
+    int capacity = 0;
+    int ret;
+
+    file = path ? fopen(path, "rb") : stdin;
+    ASSERT(file, "failed to open input file.\n");
+
+    *len = 0;
+    while (1){
+        if (*len + TPARSE_READ_SIZE > capacity){
+            char* new_buf;
+
+            capacity = capacity ? capacity * 2 : TPARSE_READ_SIZE * 16;
+            new_buf = (char*) realloc(buf, capacity);
+            ASSERT_TO(fail_on_read, new_buf, "failed to realloc input buffer.\n");
+            buf = new_buf;
+        }
+
+        ret = fread(&buf[*len], 1, TPARSE_READ_SIZE, file);
+        if (ret <= 0){
+            break;
+        }
+        *len += ret;
+    }
+
+    if (file != stdin){
+        fclose(file);
+    }
+    return buf;
+
+fail_on_read:
+    free(buf);
+    if (file != stdin){
+        fclose(file);
+    }
+fail:
+    return NULL;
+}
+
+// the cells draw() in ui.c would redraw, the cursor cell is redrawn
+// once more after the cursor moves away.
+static long long draw_damage(Terminal* terminal){
+    long long cells = 0;
+    int left, right;
+    int y;
+
+    for (y = terminal_next_damage(terminal, 0); y >= 0; y = terminal_next_damage(terminal, y + 1)){
+        terminal_damage(terminal, y, &left, &right);
+        cells += right - left + 1;
+        terminal_clear_damage(terminal, y);
+    }
+    terminal_mark_damage(terminal, terminal->cursor.x, terminal->cursor.y);
+    return cells;
+}
+
+static double now(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+int main(int argc, char** argv){
+    Terminal* terminal = NULL;
+    char* path = NULL;
+    char* scrollback_path = NULL;
+    char* query = NULL;
+    int search_flags = 0;
+    char* buf = NULL;
+    int cols_number = 80;
+    int rows_number = 24;
+    int repeat = 1;
+    int burst = TPARSE_BURST_SIZE;
+    int scrollback_lines = SCROLLBACK_DEFAULT_LINES;
+    TScrollback* scrollback;
+    double unpack_elapsed;
+    int lines_number;
+    int len;
+    int i, offset;
+    double start, elapsed;
+    long long total;
+    long long damaged = 0;
+    long long draws = 0;
+    struct rusage usage;
+    int ret;
+
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc){
+            cols_number = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+            rows_number = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+            repeat = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc){
+            burst = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc){
+            scrollback_lines = atoi(argv[++i]);
+        }else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc){
+            scrollback_path = argv[++i];
+        }else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc){
+            query = argv[++i];
+        }else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc){
+            query = argv[++i];
+            search_flags = SEARCH_REGEX;
+        }else{
+            path = argv[i];
+        }
+    }
+
+    buf = read_file(path, &len);
+    ASSERT(buf, "failed to read input.\n");
+
+    terminal = terminal_create( NULL,
+                                cols_number,
+                                rows_number,
+                                background_color,
+                                foreground_color);
+    ASSERT_TO(fail_on_terminal, terminal, "failed to create terminal.\n");
+
+    scrollback = terminal->scrollback;
+    ret = scrollback_set_limits(scrollback, scrollback_lines, SCROLLBACK_DEFAULT_BYTES);
+    ASSERT_TO(fail_on_push, (ret == 0), "failed to set scrollback limits.\n");
+
+    if (scrollback_path){
+        ret = scrollback_open_file(scrollback, scrollback_path, terminal->styles);
+        ASSERT_TO(fail_on_push, (ret == 0), "failed to open scrollback file.\n");
+    }
+
+    start = now();
+    for (i = 0; i < repeat; i++){
+        // pushed in the same bursts the ui reads from the pty.
+        for (offset = 0; offset < len; offset += burst){
+            int chunk = len - offset;
+
+            if (chunk > burst){
+                chunk = burst;
+            }
+            ret = terminal_push(terminal, &buf[offset], chunk);
+            ASSERT_TO(fail_on_push, ret == 0, "failed to push.\n");
+
+            // the ui holds the draw back while a frame is drawn.
+            if (!terminal_synchronized(terminal)){
+                damaged += draw_damage(terminal);
+                draws++;
+            }
+        }
+    }
+    elapsed = now() - start;
+    total = (long long) len * repeat;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    lines_number = scrollback_lines_number(scrollback);
+    start = now();
+    for (i = 0; i < lines_number; i++){
+        scrollback_line(scrollback, i);
+    }
+    unpack_elapsed = now() - start;
+
+    printf("name=%s bytes=%lld seconds=%.6f mb_per_sec=%.2f ns_per_byte=%.3f peak_rss_kb=%ld "
+           "scrollback_lines=%d scrollback_bytes_per_line=%.1f unpack_ns_per_line=%.1f "
+           "redrawn_cells_per_draw=%.1f",
+           path ? (strrchr(path, '/') ? strrchr(path, '/') + 1 : path) : "stdin",
+           total,
+           elapsed,
+           elapsed > 0 ? total / elapsed / 1e6 : 0,
+           total > 0 ? (elapsed * 1e9) / total : 0,
+           usage.ru_maxrss,
+           lines_number,
+           scrollback->lines_number > 0 ? (double) scrollback->bytes / scrollback->lines_number : 0,
+           lines_number > 0 ? (unpack_elapsed * 1e9) / lines_number : 0,
+           draws > 0 ? (double) damaged / draws : 0);
+
+    if (query){
+        TSearch* search = search_create(terminal, query, search_flags);
+        double first_match = -1;
+        int more = TRUE;
+
+        ASSERT_TO(fail_on_push, search, "failed to create search.\n");
+
+        start = now();
+        while (more){
+            more = search_step(search, TPARSE_SEARCH_STEP);
+            if (first_match < 0 && search->matches_number > 0){
+                first_match = now() - start;
+            }
+        }
+        elapsed = now() - start;
+
+        printf(" search_matches=%d search_lines_read=%lld search_first_ms=%.3f search_ms=%.3f",
+               search->matches_number,
+               search->lines_read,
+               first_match * 1e3,
+               elapsed * 1e3);
+        search_destroy(search);
+    }
+    printf("\n");
+
+    terminal_destroy(terminal);
+    free(buf);
+    return 0;
+
+fail_on_push:
+    terminal_destroy(terminal);
+fail_on_terminal:
+    free(buf);
+fail:
+    return -1;
+}
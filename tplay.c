@@ -0,0 +1,172 @@
+#include "terminal.h"
+#include "record.h"
+#include "common.h"
+#include "utf8.h"
+
+#include <string.h>
+#include <time.h>
+
+/*
+ * Plays a session recorded by the terminal (see record.h) on the
+ * terminal it runs in. Seeking restores the nearest keyframe and
+ * pushes only the chunks after it, then the reconstructed screen is
+ * drawn and the rest of the session is played from there.
+ *
+ * usage: tplay [-f] [-s seconds] [-e seconds] [-d] file
+ *      -f  as fast as possible instead of real time.
+ *      -s  start playing from this point.
+ *      -e  stop playing at this point.
+ *      -d  don't play, only print the screen at the end point as text.
+ */
+
+char background_color[] = "#000000";
+char foreground_color[] = "#FFFFFF";
+
+static void sleep_us(long long us){
+    struct timespec ts = {
+        .tv_sec = us / 1000000,
+        .tv_nsec = (us % 1000000) * 1000
+    };
+
+    nanosleep(&ts, NULL);
+}
+
+static void print_color(int base, unsigned int color){
+    // same mapping as the ui, indexes below 256 and true color above.
+    if (color < 256){
+        printf("\033[%d;5;%um", base, color);
+    }else{
+        printf("\033[%d;2;%u;%u;%um",
+               base,
+               (color >> 16) & 0xFF,
+               (color >> 8) & 0xFF,
+               color & 0xFF);
+    }
+}
+
+static void print_screen(Terminal* terminal, int text_only){
+    char utf8[CLUSTER_UTF8_MAX];
+    int x, y, len;
+
+    if (!text_only){
+        printf("\033[0m\033[H\033[2J");
+    }
+
+    for (y = 0; y < terminal->rows_number; y++){
+        int last_style = -1;
+
+        for (x = 0; x < terminal->cols_number; x++){
+            TElement* element = terminal_element(terminal, x, y);
+            TStyle* style = terminal_style(terminal, element->style);
+
+            // only when the style changes.
+            if (!text_only && element->style != last_style){
+                print_color(38, style->foreground_color);
+                print_color(48, style->background_color);
+                printf((style->attributes & BOLD_ATTR) ? "\033[1m" : "\033[22m");
+                printf((style->attributes & REVERSE_ATTR) ? "\033[7m" : "\033[27m");
+                last_style = element->style;
+            }
+
+            // a wide character already took the spacer's column.
+            if (element->character_code == ELEMENT_SPACER){
+                continue;
+            }
+            len = cluster_encode(terminal->clusters, element->character_code, utf8);
+            fwrite(utf8, 1, len, stdout);
+        }
+        printf(text_only ? "\n" : "\033[0m\r\n");
+    }
+
+    if (!text_only){
+        printf("\033[%d;%dH", terminal->cursor.y + 1, terminal->cursor.x + 1);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char** argv){
+    Terminal* terminal = NULL;
+    TPlayer* player = NULL;
+    TRecordFrame frame;
+    char* data;
+    char* path = NULL;
+    int fast = FALSE;
+    int dump = FALSE;
+    long long start = 0;
+    long long end = -1;
+    long long last_time;
+    int i;
+    int ret;
+
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-f") == 0){
+            fast = TRUE;
+        }else if (strcmp(argv[i], "-d") == 0){
+            dump = TRUE;
+        }else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc){
+            start = atof(argv[++i]) * 1000000;
+        }else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc){
+            end = atof(argv[++i]) * 1000000;
+        }else{
+            path = argv[i];
+        }
+    }
+    if (!path){
+        fprintf(stderr, "usage: %s [-f] [-s seconds] [-e seconds] [-d] file\n", argv[0]);
+        return -1;
+    }
+
+    player = player_create(path);
+    ASSERT(player, "failed to open record.\n");
+
+    terminal = terminal_create(NULL, 80, 24, background_color, foreground_color);
+    ASSERT_TO(fail_on_terminal, terminal, "failed to create terminal.\n");
+
+    if (dump){
+        ret = player_seek(player, terminal, end < 0 ? player->duration : end);
+        ASSERT_TO(fail_on_play, ret == 0, "failed to seek.\n");
+
+        print_screen(terminal, TRUE);
+        goto done;
+    }
+
+    ret = player_seek(player, terminal, start);
+    ASSERT_TO(fail_on_play, ret == 0, "failed to seek.\n");
+    print_screen(terminal, FALSE);
+
+    last_time = start;
+    while (1){
+        ret = player_step(player, terminal, &frame, &data);
+        ASSERT_TO(fail_on_play, (ret >= 0), "failed to play.\n");
+        if (ret == 1 || (end >= 0 && frame.time > end)){
+            break;
+        }
+
+        if (!fast && frame.time > last_time){
+            sleep_us(frame.time - last_time);
+        }
+        last_time = frame.time;
+
+        // the chunk as it was read from the pty, the player terminal
+        // is kept in sync only to redraw after a resize.
+        if (frame.type == RECORD_FRAME_CHUNK){
+            fwrite(data, 1, frame.length, stdout);
+            fflush(stdout);
+        }else if (frame.type == RECORD_FRAME_RESIZE){
+            print_screen(terminal, FALSE);
+        }
+    }
+    printf("\033[0m\r\n");
+
+done:
+    terminal_destroy(terminal);
+    player_destroy(player);
+    return 0;
+
+fail_on_play:
+    terminal_destroy(terminal);
+fail_on_terminal:
+    player_destroy(player);
+fail:
+    return -1;
+}
@@ -0,0 +1,26 @@
+#include "trigram.h"
+
+
+void trigram_filter_add(TTrigramFilter* filter, char* text, int len){
+    unsigned char* p = (unsigned char*) text;
+    unsigned int value = 0;
+    int rolled = 0;
+    int i;
+
+    // the trigram rolls over the text a byte at a time, the bytes a
+    // search never has are skipped as if they were not there.
+    for (i = 0; i < len; i++){
+        unsigned int hash;
+
+        if (p[i] == TRIGRAM_SKIPPED_LOW || p[i] == TRIGRAM_SKIPPED_HIGH){
+            continue;
+        }
+
+        value = (value << 8) | trigram_fold(p[i]);
+        if (++rolled < 3){
+            continue;
+        }
+        hash = trigram_hash_value(value);
+        filter->bits[hash / 64] |= 1ULL << (hash % 64);
+    }
+}
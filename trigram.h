@@ -0,0 +1,59 @@
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+/*
+ * The trigrams of a block of text, hashed to a bit each, which tell the
+ * blocks a search can skip without reading them: a block with a bit of
+ * the text not set can't contain it, one with all of them set may and
+ * has to be read. ascii letters are folded to lower case so the same
+ * filter serves searches which ignore case.
+ *
+ * A block of SCROLLBACK_SEGMENT_LINES lines has a few thousand distinct
+ * trigrams, about a third of the bits are set.
+ */
+
+#define TRIGRAM_HASH_BITS   (13)
+#define TRIGRAM_HASHES      (1 << TRIGRAM_HASH_BITS)
+
+// never in the text searched, the spacers and breaks of the scrollback
+// text (see scrollback.c) are left out of the trigrams.
+#define TRIGRAM_SKIPPED_LOW     (0x00)
+#define TRIGRAM_SKIPPED_HIGH    (0xFF)
+
+typedef struct{
+    unsigned long long bits[TRIGRAM_HASHES / 64];
+}TTrigramFilter;
+
+
+static inline unsigned int trigram_fold(unsigned char c){
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// of the 3 folded bytes in the low bits of value.
+static inline unsigned int trigram_hash_value(unsigned int value){
+    return ((value & 0xFFFFFF) * 2654435761U) >> (32 - TRIGRAM_HASH_BITS);
+}
+
+// the hash of the 3 bytes at text.
+static inline unsigned int trigram_hash(char* text){
+    unsigned char* p = (unsigned char*) text;
+
+    return trigram_hash_value((trigram_fold(p[0]) << 16) | (trigram_fold(p[1]) << 8) | trigram_fold(p[2]));
+}
+
+// the bytes TRIGRAM_SKIPPED_LOW and TRIGRAM_SKIPPED_HIGH are skipped.
+void trigram_filter_add(TTrigramFilter* filter, char* text, int len);
+
+// whether the block may have every trigram of the hashes.
+static inline int trigram_filter_test(TTrigramFilter* filter, unsigned int* hashes, int hashes_number){
+    int i;
+
+    for (i = 0; i < hashes_number; i++){
+        if (!(filter->bits[hashes[i] / 64] & (1ULL << (hashes[i] % 64)))){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#endif
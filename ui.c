@@ -2,6 +2,7 @@
 #include "color.h"
 
 #include <time.h>
+#include <signal.h>
 
 
 // ------------------------------------------------------------------------------------
@@ -31,15 +32,26 @@ Key* get_key_by_event(Display* display, XKeyEvent* event){
     return NULL;
 }
 
+// what is read from the pty before a draw. a burst is pushed whole, so
+// the lines which scroll off before the draw are fast forwarded.
+#define READ_BURST_SIZE (64 * 1024)
+
 int read_from_pty(){
+    static char buf[READ_BURST_SIZE];
+    int bytes_read = 0;
     int ret;
-    char buf[4096];
-    int bytes_read = 1;
 
-    memset(buf, 0, sizeof(buf));
+    do{
+        ret = pty_read(xterminal.pty, &buf[bytes_read], sizeof(buf) - bytes_read);
+        ASSERT((ret >= 0), "failed to read from pty.\n");
+
+        bytes_read += ret;
+    }while (ret > 0 && bytes_read < sizeof(buf) && pty_pending(xterminal.pty));
 
-    bytes_read = pty_read(xterminal.pty, buf, sizeof(buf));
-    ASSERT((bytes_read >= 0), "failed to read from pty.\n");
+    if (xterminal.recorder){
+        ret = record_chunk(xterminal.recorder, xterminal.terminal, buf, bytes_read);
+        ASSERT((ret == 0), "failed to record chunk.\n");
+    }
 
     ret = terminal_push(xterminal.terminal, buf, bytes_read);
     ASSERT((ret == 0), "failed to push to terminal.\n");
@@ -95,6 +107,11 @@ void on_configure_notify(XEvent* event){
     ret = terminal_resize(xterminal.terminal, cols_number, rows_number);
     ASSERT(ret == 0, "failed to resize terminal.\n");
 
+    if (xterminal.recorder){
+        ret = record_resize(xterminal.recorder, cols_number, rows_number);
+        ASSERT(ret == 0, "failed to record resize.\n");
+    }
+
 fail:
     return;
 }
@@ -205,6 +222,9 @@ int destroy_fonts(){
 }
 
 int end(){
+    if (xterminal.recorder){
+        record_destroy(xterminal.recorder);
+    }
     pty_destroy(xterminal.pty);
     destroy_colors();
     destroy_fonts();
@@ -221,20 +241,22 @@ int draw_element(TElement* element, int x, int y){
     unsigned int current_foreground_color = 0;
     unsigned int current_background_color = 0;
 
+    TStyle* style = terminal_style(xterminal.terminal, element->style);
+
     // create the colors
     // XColor
-    unsigned int element_foreground_color = element->foreground_color;
-    unsigned int element_background_color = element->background_color;
+    unsigned int element_foreground_color = style->foreground_color;
+    unsigned int element_background_color = style->background_color;
 
     if ((x == xterminal.terminal->cursor.x) &&
         (y == xterminal.terminal->cursor.y)){
-        element_foreground_color = element->background_color;
-        element_background_color = element->foreground_color;
+        element_foreground_color = style->background_color;
+        element_background_color = style->foreground_color;
     }
 
-    if (element->attributes & REVERSE_ATTR){
-        element_foreground_color = element->background_color;
-        element_background_color = element->foreground_color;
+    if (style->attributes & REVERSE_ATTR){
+        element_foreground_color = style->background_color;
+        element_background_color = style->foreground_color;
     }
 
 	XRenderColor color = { .alpha = 0xffff };
@@ -283,51 +305,73 @@ int draw_element(TElement* element, int x, int y){
     ASSERT(ret != 0, "failed to allocate color.\n");
 
     XftFont* current_font = xterminal.font->normal_font;
-    if (element->attributes & BOLD_ATTR){
+    if (style->attributes & BOLD_ATTR){
         current_font = xterminal.font->bold_font;
     }
 
-    // create the glyph font spec
-    FT_UInt glyph_index = XftCharIndex( xterminal.display, 
-                                        current_font,
-                                        element->character_code);
-
-    if (glyph_index){
-        int draw_x, draw_y;
-
-        draw_x = border_pixels + (x * xterminal.font->width);
-        draw_y = border_pixels + (y * xterminal.font->height);
-
-        // draw background
-        XftDrawRect(xterminal.xft_draw, 
-                &xft_background_color, 
-                draw_x,
-                draw_y,
-                xterminal.font->width,
-                xterminal.font->height);
-
-        /* Set the clip region because Xft is sometimes dirty. */
-        XRectangle rectangle;
-        rectangle.x = 0;
-        rectangle.y = 0;
-        rectangle.height = xterminal.font->height;
-        rectangle.width = xterminal.font->width;
-        XftDrawSetClipRectangles(xterminal.xft_draw, draw_x, draw_y, &rectangle, 1);
+    // a wide character is drawn over the spacer after it.
+    int cells = 1;
+    if (x + 1 < xterminal.terminal->cols_number && element[1].character_code == ELEMENT_SPACER){
+        cells = 2;
+    }
 
-        xft_glyph_spec.font = current_font;
-        xft_glyph_spec.glyph = glyph_index;
-        xft_glyph_spec.x = draw_x;
-        // it is important to add the ascent  to the y.
-        xft_glyph_spec.y = draw_y + xterminal.font->normal_font->ascent;
+    int draw_x = border_pixels + (x * xterminal.font->width);
+    int draw_y = border_pixels + (y * xterminal.font->height);
 
-        // draw foreground
-        XftDrawGlyphFontSpec(   xterminal.xft_draw, 
-                                &xft_foreground_color, 
-                                &xft_glyph_spec, 
-                                1);
+    // draw background
+    XftDrawRect(xterminal.xft_draw, 
+            &xft_background_color, 
+            draw_x,
+            draw_y,
+            cells * xterminal.font->width,
+            xterminal.font->height);
 
-        /* Reset clip to none. */
+    /* Set the clip region because Xft is sometimes dirty. */
+    XRectangle rectangle;
+    rectangle.x = 0;
+    rectangle.y = 0;
+    rectangle.height = xterminal.font->height;
+    rectangle.width = cells * xterminal.font->width;
+
+    if (element->character_code & ELEMENT_CLUSTER){
+        unsigned int* codes;
+        int length = terminal_codes(xterminal.terminal, element, &codes);
+
+        // the codepoints of a cluster are drawn as one run, the marks
+        // have no advance and land on the character.
+        XftDrawSetClipRectangles(xterminal.xft_draw, draw_x, draw_y, &rectangle, 1);
+        XftDrawString32(xterminal.xft_draw,
+                        &xft_foreground_color,
+                        current_font,
+                        draw_x,
+                        draw_y + xterminal.font->normal_font->ascent,
+                        (FcChar32*) codes,
+                        length);
         XftDrawSetClip(xterminal.xft_draw, 0);
+    }else{
+        // create the glyph font spec
+        FT_UInt glyph_index = XftCharIndex( xterminal.display, 
+                                            current_font,
+                                            element->character_code);
+
+        if (glyph_index){
+            XftDrawSetClipRectangles(xterminal.xft_draw, draw_x, draw_y, &rectangle, 1);
+
+            xft_glyph_spec.font = current_font;
+            xft_glyph_spec.glyph = glyph_index;
+            xft_glyph_spec.x = draw_x;
+            // it is important to add the ascent  to the y.
+            xft_glyph_spec.y = draw_y + xterminal.font->normal_font->ascent;
+
+            // draw foreground
+            XftDrawGlyphFontSpec(   xterminal.xft_draw, 
+                                    &xft_foreground_color, 
+                                    &xft_glyph_spec, 
+                                    1);
+
+            /* Reset clip to none. */
+            XftDrawSetClip(xterminal.xft_draw, 0);
+        }
     }
 
     XftColorFree(   xterminal.display,
@@ -379,27 +423,41 @@ int clean_screen(){
 }
 
 int draw(){
+    Terminal* terminal = xterminal.terminal;
+    TElement* element;
     int ret;
     int x,y;
+    int left, right;
 
-    for (y = 0; y < xterminal.terminal->rows_number; y++){
-        for (x = 0; x < xterminal.terminal->cols_number; x++){
-            TElement* element = terminal_element(xterminal.terminal, x, y);
-            if (element->dirty == 1){
-                ret = draw_element(element, x, y);
-                ASSERT(ret == 0, "failed to draw element.\n");
-                element->dirty = 0;
-            }
-            // manual set dirty if cursor.
-            if (x == xterminal.terminal->cursor.x &&
-                    y == xterminal.terminal->cursor.y){
-                ret = draw_element(element, x, y);
-                ASSERT(ret == 0, "failed to draw element.\n");
-                element->dirty = 1;
+    // only the rows that changed, and only what changed in them.
+    for (y = terminal_next_damage(terminal, 0); 
+         y >= 0; 
+         y = terminal_next_damage(terminal, y + 1)){
+        terminal_damage(terminal, y, &left, &right);
+
+        // a spacer is drawn with the wide character before it.
+        if (left > 0 && terminal_element(terminal, left, y)->character_code == ELEMENT_SPACER){
+            left--;
+        }
+
+        for (x = left; x <= right; x++){
+            element = terminal_element(terminal, x, y);
+            if (element->character_code == ELEMENT_SPACER && x > left){
+                continue;
             }
+            ret = draw_element(element, x, y);
+            ASSERT(ret == 0, "failed to draw element.\n");
         }
+        terminal_clear_damage(terminal, y);
     }
 
+    // the cursor is drawn over its element, so it has to be 
+    // redrawn once the cursor moves away.
+    element = terminal_element(terminal, terminal->cursor.x, terminal->cursor.y);
+    ret = draw_element(element, terminal->cursor.x, terminal->cursor.y);
+    ASSERT(ret == 0, "failed to draw element.\n");
+    terminal_mark_damage(terminal, terminal->cursor.x, terminal->cursor.y);
+
     // all drawing takes effect here.
 	XCopyArea(  xterminal.display, 
                 xterminal.drawable,
@@ -418,6 +476,8 @@ fail:
 }
 
 int start(){
+    int ret;
+
     // create connection to the x server
     xterminal.display = XOpenDisplay(NULL);
     ASSERT(xterminal.display, "failed to open dispaly.\n");
@@ -445,6 +505,18 @@ int start(){
                                             foreground_color);
     ASSERT(xterminal.terminal, "failed to create terminal.\n");
 
+    ret = scrollback_set_limits(xterminal.terminal->scrollback, scrollback_lines, scrollback_bytes);
+    ASSERT((ret == 0), "failed to set scrollback limits.\n");
+
+    if (scrollback_file_path[0]){
+        ret = scrollback_open_file(xterminal.terminal->scrollback,
+                                   scrollback_file_path,
+                                   xterminal.terminal->styles);
+        if (ret != 0){
+            LOG_ERROR("failed to open scrollback file, history is kept in memory only.\n");
+        }
+    }
+
     Window parent;
     XSetWindowAttributes attrs;
     attrs.background_pixel = xterminal.background_color.pixel;
@@ -535,6 +607,37 @@ int is_xevent_pending(){
     return ret > 0;
 }
 
+/*
+ * Whether the draw waits for the frame the application is drawing, 
+ * which is drawn anyway once it is open for the timeout.
+ */
+int hold_draw(){
+    static double since = -1;
+    struct timespec now;
+    double now_ms;
+
+    if (!terminal_synchronized(xterminal.terminal)){
+        since = -1;
+        return FALSE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    now_ms = (now.tv_sec * 1e3) + (now.tv_nsec / 1e6);
+
+    if (since < 0){
+        since = now_ms;
+    }
+    if (now_ms - since < synchronized_update_timeout_ms){
+        return TRUE;
+    }
+    since = now_ms;
+    return FALSE;
+}
+
+// set by SIGUSR1, the trace is toggled by the main loop, out of the
+// signal handler.
+static volatile sig_atomic_t trace_toggled = 0;
+
 int run(){
     int ret;
     int to_draw = FALSE;
@@ -553,6 +656,11 @@ int run(){
     clean_screen();
 
     while (TRUE){
+        if (trace_toggled){
+            trace_toggled = 0;
+            log_set_trace(!log_trace_enabled);
+        }
+
         if (is_xevent_pending()){
             while(XPending(xterminal.display)){
                 XNextEvent(xterminal.display, &event);
@@ -571,7 +679,7 @@ int run(){
             to_draw = TRUE;
         }
 
-        if (to_draw){
+        if (to_draw && !hold_draw()){
             ret = draw();
             ASSERT(ret == 0, "failed to draw.\n");
 
@@ -586,13 +694,35 @@ fail:
     return -1;
 }
 
-int main(){
+void sigusr1_handler(int arg){
+    trace_toggled = 1;
+}
+
+int main(int argc, char** argv){
+    char* record_path = NULL;
     int ret;
 
+    // -r <file> records the session, play it with tplay.
+    if (argc == 3 && strcmp(argv[1], "-r") == 0){
+        record_path = argv[2];
+    }
+
+    ret = log_start(log_file_path);
+    if (ret == 0){
+        atexit(log_stop);
+    }
+    log_set_trace(trace_sequences);
+    signal(SIGUSR1, sigusr1_handler);
+
     LOG("terminal has started.\n");
     ret = start();
     ASSERT(ret == 0, "failed to start terminal.\n");
 
+    if (record_path){
+        xterminal.recorder = record_create(record_path, xterminal.terminal);
+        ASSERT(xterminal.recorder, "failed to start recording.\n");
+    }
+
     ret = run();
     ASSERT(ret == 0, "failed to run terminal.\n");
 
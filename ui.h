@@ -11,6 +11,7 @@
 #include "element.h"
 #include "pty.h"
 #include "font.h"
+#include "record.h"
 
 
 typedef struct{
@@ -32,6 +33,8 @@ typedef struct{
 
     TPty* pty;
 
+    TRecorder* recorder; // NULL unless recording the session.
+
     int x;
     int y;
     unsigned int width;
@@ -41,7 +44,7 @@ typedef struct{
 static XTerminal xterminal;
 
 
-int main();
+int main(int argc, char** argv);
 
 // -----------------------------------------------------------------------
 // configuration
@@ -57,12 +60,32 @@ unsigned int cols = 80;
 unsigned int rows = 24;
 unsigned int border_pixels = 1;
 
+// the oldest lines are dropped at whichever limit comes first.
+int scrollback_lines = 10000;
+size_t scrollback_bytes = 32 * 1024 * 1024;
+
+// when set, every line is also appended to this file, which keeps the
+// whole history (even after a crash) and is recovered on the next start.
+char scrollback_file_path[] = "";
+
+// a frame the application draws as a synchronized update (mode 2026) is
+// drawn once done, or every this many milliseconds while it is not.
+unsigned int synchronized_update_timeout_ms = 150;
+
 // -----------------------------------------------------------------------
 // colors
 // -----------------------------------------------------------------------
 char background_color[] = "#3C3C3C";
 char foreground_color[] = "#C0C0C0";
 
+// -----------------------------------------------------------------------
+// logging
+// -----------------------------------------------------------------------
+char log_file_path[] = LOG_DEFAULT_FILE_PATH;
+
+// per sequence tracing, can be toggled at runtime with SIGUSR1.
+int trace_sequences = FALSE;
+
 // -----------------------------------------------------------------------
 // keys
 // -----------------------------------------------------------------------
@@ -0,0 +1,33 @@
+#ifndef UNICODE_H
+#define UNICODE_H
+
+/*
+ * What the terminal needs to know to lay a codepoint out, a byte looked
+ * up in two levels: the block of 256 codepoints picks one of the
+ * distinct blocks of properties in the generated unicode_table.c (see
+ * unicode/gen_tables.c).
+ */
+
+#define UNICODE_CODES               (0x110000)
+
+#define UNICODE_WIDTH_MASK          (0x03)      // the cells taken, 0 to 2.
+#define UNICODE_COMBINING           (1 << 2)    // goes with the character before.
+#define UNICODE_EMOJI_PRESENTATION  (1 << 3)
+#define UNICODE_PICTOGRAPHIC        (1 << 4)    // Extended_Pictographic.
+
+extern const unsigned char unicode_blocks[UNICODE_CODES >> 8];
+extern const unsigned char unicode_properties_table[][256];
+
+static inline unsigned int unicode_properties(unsigned int code){
+    // anything past the last plane reads as its last codepoint,
+    // a noncharacter of a single cell.
+    code = code < UNICODE_CODES ? code : UNICODE_CODES - 1;
+
+    return unicode_properties_table[unicode_blocks[code >> 8]][code & 0xFF];
+}
+
+static inline int unicode_width(unsigned int code){
+    return unicode_properties(code) & UNICODE_WIDTH_MASK;
+}
+
+#endif
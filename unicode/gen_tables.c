@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Writes unicode_table.c, the properties of every codepoint the terminal
+ * needs to lay characters out, from the unicode character database:
+ *
+ *      UnicodeData.txt     general category, marks and format
+ *                          characters take no cell, they go with
+ *                          the character before.
+ *      EastAsianWidth.txt  wide and fullwidth characters take 2 cells.
+ *      emoji-data.txt      Emoji_Presentation (2 cells as well),
+ *                          Emoji_Modifier (the skin tones, which go
+ *                          with the emoji before) and
+ *                          Extended_Pictographic.
+ *
+ * The properties are a byte for every codepoint, which is looked up in
+ * two levels (see unicode.h): the codepoint without its low 8 bits
+ * picks a block of 256 bytes, and equal blocks are stored once.
+ *
+ * usage: gen_tables <directory of the data files> > unicode_table.c
+ */
+
+#define CODES           (0x110000)
+#define BLOCK_BITS      (8)
+#define BLOCK_SIZE      (1 << BLOCK_BITS)
+#define BLOCKS          (CODES / BLOCK_SIZE)
+
+// same as in unicode.h.
+#define WIDTH_MASK          (0x03)
+#define COMBINING           (1 << 2)
+#define EMOJI_PRESENTATION  (1 << 3)
+#define PICTOGRAPHIC        (1 << 4)
+
+#define LINE_SIZE (1024)
+
+static unsigned char properties[CODES];
+
+static FILE* open_data(char* directory, char* name, char* version, int version_size){
+    char path[LINE_SIZE];
+    char line[LINE_SIZE];
+    FILE* file;
+
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    file = fopen(path, "r");
+    if (!file){
+        fprintf(stderr, "failed to open %s.\n", path);
+        exit(1);
+    }
+
+    // the first line names the file with its version, if any.
+    version[0] = 0;
+    if (fgets(line, sizeof(line), file) && line[0] == '#'){
+        line[strcspn(line, "\r\n")] = 0;
+        snprintf(version, version_size, "%s", line + 2);
+    }
+    rewind(file);
+    return file;
+}
+
+// "XXXX" or "XXXX..YYYY", returns 0 if there is no codepoint.
+static int parse_range(char* field, unsigned int* first, unsigned int* last){
+    char* end;
+
+    *first = strtoul(field, &end, 16);
+    if (end == field){
+        return 0;
+    }
+    *last = *first;
+    if (end[0] == '.' && end[1] == '.'){
+        *last = strtoul(end + 2, NULL, 16);
+    }
+    return *first <= *last && *last < CODES;
+}
+
+static void set_width(unsigned int first, unsigned int last, int width){
+    unsigned int code;
+
+    for (code = first; code <= last; code++){
+        properties[code] = (properties[code] & ~WIDTH_MASK) | width;
+    }
+}
+
+static void add_property(unsigned int first, unsigned int last, int property){
+    unsigned int code;
+
+    for (code = first; code <= last; code++){
+        properties[code] |= property;
+    }
+}
+
+static void read_unicode_data(char* directory, char* version, int version_size){
+    char line[LINE_SIZE];
+    unsigned int first = 0;
+    FILE* file;
+
+    file = open_data(directory, "UnicodeData.txt", version, version_size);
+
+    while (fgets(line, sizeof(line), file)){
+        char* fields[3];
+        unsigned int code;
+        int i;
+
+        fields[0] = strtok(line, ";");
+        for (i = 1; i < 3; i++){
+            fields[i] = strtok(NULL, ";");
+        }
+        if (!fields[2]){
+            continue;
+        }
+        code = strtoul(fields[0], NULL, 16);
+
+        // the ranges are given by their first and last codepoints.
+        if (strstr(fields[1], ", First>")){
+            first = code;
+            continue;
+        }
+        if (!strstr(fields[1], ", Last>")){
+            first = code;
+        }
+
+        // spacing marks included, as most terminals do. the soft
+        // hyphen is shown, the other format characters are not.
+        if (fields[2][0] == 'M' ||
+            (strcmp(fields[2], "Cf") == 0 && code != 0x00AD)){
+            set_width(first, code, 0);
+            add_property(first, code, COMBINING);
+        }
+    }
+    fclose(file);
+
+    // the medial vowels and final consonants of the hangul jamo make a
+    // syllable with the leading consonant before them.
+    set_width(0x1160, 0x11FF, 0);
+    add_property(0x1160, 0x11FF, COMBINING);
+    set_width(0xD7B0, 0xD7FF, 0);
+    add_property(0xD7B0, 0xD7FF, COMBINING);
+}
+
+static void read_east_asian_width(char* directory, char* version, int version_size){
+    char line[LINE_SIZE];
+    unsigned int first, last;
+    FILE* file;
+
+    file = open_data(directory, "EastAsianWidth.txt", version, version_size);
+
+    while (fgets(line, sizeof(line), file)){
+        char* value = strchr(line, ';');
+
+        if (line[0] == '#' || !value || !parse_range(line, &first, &last)){
+            continue;
+        }
+        value++;
+        while (*value == ' '){
+            value++;
+        }
+
+        if (value[0] == 'W' || value[0] == 'F'){
+            unsigned int code;
+
+            // a combining mark stays a combining mark.
+            for (code = first; code <= last; code++){
+                if (!(properties[code] & COMBINING)){
+                    set_width(code, code, 2);
+                }
+            }
+        }
+    }
+    fclose(file);
+}
+
+// whether the value of a property line is the property name.
+static int is_property(char* value, char* name){
+    int length = strlen(name);
+
+    return strncmp(value, name, length) == 0 && strchr(" \t#\r\n", value[length]);
+}
+
+static void read_emoji_data(char* directory, char* version, int version_size){
+    char line[LINE_SIZE];
+    unsigned int first, last;
+    FILE* file;
+
+    file = open_data(directory, "emoji-data.txt", version, version_size);
+
+    while (fgets(line, sizeof(line), file)){
+        char* value = strchr(line, ';');
+
+        if (line[0] == '#' || !value || !parse_range(line, &first, &last)){
+            continue;
+        }
+        value++;
+        while (*value == ' '){
+            value++;
+        }
+
+        if (is_property(value, "Emoji_Presentation")){
+            set_width(first, last, 2);
+            add_property(first, last, EMOJI_PRESENTATION);
+        }else if (is_property(value, "Emoji_Modifier")){
+            set_width(first, last, 0);
+            add_property(first, last, COMBINING);
+        }else if (is_property(value, "Extended_Pictographic")){
+            add_property(first, last, PICTOGRAPHIC);
+        }
+    }
+    fclose(file);
+}
+
+int main(int argc, char** argv){
+    static int block_of[BLOCKS];
+    static int unique[BLOCKS];
+    char versions[3][LINE_SIZE];
+    int unique_number = 0;
+    int block, i, j;
+
+    if (argc != 2){
+        fprintf(stderr, "usage: %s <directory of the data files>\n", argv[0]);
+        return 1;
+    }
+
+    // every other codepoint takes a cell.
+    memset(properties, 1, sizeof(properties));
+
+    read_unicode_data(argv[1], versions[0], LINE_SIZE);
+    read_east_asian_width(argv[1], versions[1], LINE_SIZE);
+    read_emoji_data(argv[1], versions[2], LINE_SIZE);
+
+    for (block = 0; block < BLOCKS; block++){
+        for (i = 0; i < unique_number; i++){
+            if (memcmp(&properties[unique[i] * BLOCK_SIZE], &properties[block * BLOCK_SIZE], BLOCK_SIZE) == 0){
+                break;
+            }
+        }
+        if (i == unique_number){
+            unique[unique_number++] = block;
+        }
+        block_of[block] = i;
+    }
+
+    if (unique_number > 256){
+        fprintf(stderr, "%d distinct blocks do not fit the first level.\n", unique_number);
+        return 1;
+    }
+
+    printf("// generated by unicode/gen_tables, do not edit (see `make unicode`).\n");
+    for (i = 0; i < 3; i++){
+        if (versions[i][0]){
+            printf("// %s\n", versions[i]);
+        }
+    }
+    printf("\n#include \"unicode.h\"\n\n");
+
+    printf("const unsigned char unicode_blocks[%d] = {", BLOCKS);
+    for (block = 0; block < BLOCKS; block++){
+        printf("%s%d,", (block % 16) ? " " : "\n    ", block_of[block]);
+    }
+    printf("\n};\n\n");
+
+    printf("const unsigned char unicode_properties_table[%d][%d] = {\n", unique_number, BLOCK_SIZE);
+    for (i = 0; i < unique_number; i++){
+        printf("    {");
+        for (j = 0; j < BLOCK_SIZE; j++){
+            printf("%s%d,", (j % 32) ? "" : "\n        ", properties[(unique[i] * BLOCK_SIZE) + j]);
+        }
+        printf("\n    },\n");
+    }
+    printf("};\n");
+    return 0;
+}
@@ -1,4 +1,11 @@
 #include "utf8.h"
+#include "common.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 
 const unsigned char utf8d[] = {
@@ -32,3 +39,208 @@ unsigned int utf8_decode(unsigned int* state,
 
   return *state;
 }
+
+/*
+ * Expands a block of ascii bytes to codepoints, returns the number of 
+ * bytes expanded, 0 if the block contains non ascii bytes.
+ */
+static inline int utf8_expand_ascii_block(unsigned char* buf, unsigned int* codepoints){
+#ifdef __AVX2__
+    __m256i block = _mm256_loadu_si256((__m256i*) buf);
+
+    if (_mm256_movemask_epi8(block) != 0){
+        return 0;
+    }
+
+    int i;
+    for (i = 0; i < 32; i += 8){
+        __m128i bytes = _mm_loadl_epi64((__m128i*) &buf[i]);
+        _mm256_storeu_si256((__m256i*) &codepoints[i], _mm256_cvtepu8_epi32(bytes));
+    }
+    return 32;
+#elif defined(__SSE2__)
+    __m128i block = _mm_loadu_si128((__m128i*) buf);
+    __m128i zero = _mm_setzero_si128();
+
+    if (_mm_movemask_epi8(block) != 0){
+        return 0;
+    }
+
+    __m128i low = _mm_unpacklo_epi8(block, zero);
+    __m128i high = _mm_unpackhi_epi8(block, zero);
+
+    _mm_storeu_si128((__m128i*) &codepoints[0], _mm_unpacklo_epi16(low, zero));
+    _mm_storeu_si128((__m128i*) &codepoints[4], _mm_unpackhi_epi16(low, zero));
+    _mm_storeu_si128((__m128i*) &codepoints[8], _mm_unpacklo_epi16(high, zero));
+    _mm_storeu_si128((__m128i*) &codepoints[12], _mm_unpackhi_epi16(high, zero));
+    return 16;
+#else
+    return 0;
+#endif
+}
+
+#ifdef __AVX2__
+#define UTF8_BLOCK_SIZE 32
+#else
+#define UTF8_BLOCK_SIZE 16
+#endif
+
+#ifdef __SSE2__
+// the mask of the bytes of block from low to high, unsigned.
+static inline unsigned int utf8_range_mask(__m128i block, unsigned char low, unsigned char high){
+    __m128i offset = _mm_sub_epi8(block, _mm_set1_epi8(low));
+    __m128i limit = _mm_set1_epi8(high - low);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(offset, limit), offset));
+}
+
+// the length of a sequence by the high bits of its lead byte (0 for
+// continuation bytes) and the bits of the lead byte that are kept.
+static const unsigned char utf8_lengths[16] = {1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 2, 2, 3, 4};
+static const unsigned char utf8_lead_masks[5] = {0, 0x7F, 0x1F, 0x0F, 0x07};
+
+// the continuation bytes that every lead byte of leads takes.
+#define UTF8_CONTINUATIONS(l2, l3, l4)  (((l2 | l3 | l4) << 1) | ((l3 | l4) << 2) | (l4 << 3))
+
+/*
+ * Decodes the sequences of a block of 16 bytes which starts on a
+ * sequence, but the last one if it goes past the block. The bytes are
+ * classified 16 at a time into a bit mask of each kind, a block is valid
+ * when the continuation bytes are exactly those the lead bytes take and
+ * none is out of the ranges the scalar decoder allows after E0, ED, F0
+ * and F4. Returns the number of bytes decoded, 0 if the block is not
+ * valid and has to be decoded (and reported) by the scalar decoder.
+ */
+static inline int utf8_decode_block(unsigned char* buf, unsigned int* codepoints, int* count){
+    __m128i block = _mm_loadu_si128((__m128i*) buf);
+    unsigned int ascii = ~_mm_movemask_epi8(block) & 0xFFFF;
+    unsigned int cont = utf8_range_mask(block, 0x80, 0xBF);
+    unsigned int l2 = utf8_range_mask(block, 0xC2, 0xDF);
+    unsigned int l3 = utf8_range_mask(block, 0xE0, 0xEF);
+    unsigned int l4 = utf8_range_mask(block, 0xF0, 0xF4);
+    unsigned int leads = l2 | l3 | l4;
+    unsigned int window = 0xFFFF;
+    unsigned int errors;
+    unsigned int starts;
+    unsigned char bytes[20] = {0};
+    int n = 16;
+
+    if ((ascii | cont | leads) != 0xFFFF){
+        return 0;
+    }
+
+    // the sequence which goes past the block is left for the next one.
+    if (UTF8_CONTINUATIONS(l2, l3, l4) >> 16){
+        n = 31 - __builtin_clz(leads);
+        window = (1u << n) - 1;
+        l2 &= window;
+        l3 &= window;
+        l4 &= window;
+        leads &= window;
+    }
+    if (n == 0 || UTF8_CONTINUATIONS(l2, l3, l4) != (cont & window)){
+        return 0;
+    }
+
+    // overlong sequences, surrogates and codepoints past 0x10FFFF.
+    errors = ((_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8((char) 0xE0))) << 1) &
+              utf8_range_mask(block, 0x80, 0x9F)) |
+             ((_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8((char) 0xED))) << 1) &
+              utf8_range_mask(block, 0xA0, 0xBF)) |
+             ((_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8((char) 0xF0))) << 1) &
+              utf8_range_mask(block, 0x80, 0x8F)) |
+             ((_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8((char) 0xF4))) << 1) &
+              utf8_range_mask(block, 0x90, 0xBF));
+    if (errors & window){
+        return 0;
+    }
+
+    // every sequence is put together as if it had 4 bytes and then
+    // shifted back by the bytes it doesn't have, without branches.
+    _mm_storeu_si128((__m128i*) bytes, block);
+    for (starts = (ascii | leads) & window; starts; starts &= starts - 1){
+        unsigned char* p = &bytes[__builtin_ctz(starts)];
+        int length = utf8_lengths[p[0] >> 4];
+        unsigned int code = ((p[0] & utf8_lead_masks[length]) << 18) | ((p[1] & 0x3F) << 12) |
+                            ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+
+        codepoints[(*count)++] = code >> (6 * (4 - length));
+    }
+    return n;
+}
+#endif
+
+int utf8_decode_buffer(TUtf8Decoder* decoder,
+                       unsigned char* buf,
+                       int len,
+                       unsigned int* codepoints){
+    int count = 0;
+    int i = 0;
+
+    while (i < len){
+        // whole ascii blocks are expanded at once.
+        if ((decoder->state == UTF8_ACCEPT) && (i + UTF8_BLOCK_SIZE <= len)){
+            int expanded = utf8_expand_ascii_block(&buf[i], &codepoints[count]);
+            if (expanded > 0){
+                i += expanded;
+                count += expanded;
+                continue;
+            }
+
+#ifdef __SSE2__
+            // and the blocks with multibyte sequences as well, if valid.
+            expanded = utf8_decode_block(&buf[i], codepoints, &count);
+            if (expanded > 0){
+                i += expanded;
+                continue;
+            }
+#endif
+        }
+
+        // the scalar decoder handles the rest of the block.
+        int block_end = i + UTF8_BLOCK_SIZE;
+        if (block_end > len){
+            block_end = len;
+        }
+
+        for (; i < block_end; i++){
+            if (!utf8_decode(&decoder->state, &decoder->codep, buf[i])){
+                codepoints[count] = decoder->codep;
+                count++;
+                decoder->codep = 0;
+            }
+
+            if (decoder->state == UTF8_REJECT){
+                LOG_DEBUG("utf8 code mallformed\n");
+
+                decoder->state = UTF8_ACCEPT;
+                decoder->codep = 0;
+            }
+        }
+    }
+
+    return count;
+}
+
+int utf8_encode(unsigned int codep, char* buf){
+    if (codep < 0x80){
+        buf[0] = codep;
+        return 1;
+    }
+    if (codep < 0x800){
+        buf[0] = 0xC0 | (codep >> 6);
+        buf[1] = 0x80 | (codep & 0x3F);
+        return 2;
+    }
+    if (codep < 0x10000){
+        buf[0] = 0xE0 | (codep >> 12);
+        buf[1] = 0x80 | ((codep >> 6) & 0x3F);
+        buf[2] = 0x80 | (codep & 0x3F);
+        return 3;
+    }
+    buf[0] = 0xF0 | ((codep >> 18) & 0x07);
+    buf[1] = 0x80 | ((codep >> 12) & 0x3F);
+    buf[2] = 0x80 | ((codep >> 6) & 0x3F);
+    buf[3] = 0x80 | (codep & 0x3F);
+    return 4;
+}
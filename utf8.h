@@ -9,10 +9,33 @@
 
 #define UTF8_ACCEPT 0
 #define UTF8_REJECT 1
+#define UTF8_STATES_NUMBER 9
+
+#define UTF8_MAX_BYTES 4
+
+// keeps the state of a sequence between buffers.
+typedef struct{
+    unsigned int state;
+    unsigned int codep;
+}TUtf8Decoder;
 
 
 unsigned int utf8_decode(unsigned int* state, 
                          unsigned int* codep, 
                          unsigned int byte);
 
+/*
+ * Decodes len bytes into codepoints (which must have room for len 
+ * codepoints), a sequence which is not complete at the end of buf is 
+ * kept in the decoder for the next call. returns the number of 
+ * codepoints written.
+ */
+int utf8_decode_buffer(TUtf8Decoder* decoder,
+                       unsigned char* buf,
+                       int len,
+                       unsigned int* codepoints);
+
+// returns the number of bytes written to buf.
+int utf8_encode(unsigned int codep, char* buf);
+
 #endif